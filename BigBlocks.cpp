@@ -0,0 +1,170 @@
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include "BigBlocks.h"
+#include "HighVAArena.h"
+#include "OwnershipRegistry.h"
+
+namespace BigBlocks {
+    static const SIZE_T kGranularity = 64 * 1024;
+    static const SIZE_T kPage = 4096;
+
+    struct Block { SIZE_T size; SIZE_T reserved; SIZE_T committed; bool arena; };
+    struct Cached { uintptr_t base; SIZE_T committed; bool arena; DWORD tick; };
+
+    static SRWLOCK g_lock = SRWLOCK_INIT;
+    static std::map<uintptr_t, Block> g_blocks; // live blocks by base
+    static std::map<SIZE_T, std::vector<Cached>> g_cache; // freed reservations by class size, newest last
+    static Options g_opt;
+    static Stats g_stats = {};
+
+    struct Lock {
+        Lock() { AcquireSRWLockExclusive(&g_lock); }
+        ~Lock() { ReleaseSRWLockExclusive(&g_lock); }
+    };
+
+    // Reservation size: 64KB granules up to 1MB, then four classes per power of two
+    static SIZE_T ClassSize(SIZE_T size) {
+        SIZE_T r = HV_AlignUp(size, kGranularity);
+        if (r <= 1024 * 1024) return r;
+        unsigned long msb; _BitScanReverse(&msb, (unsigned long)(r - 1));
+        SIZE_T step = (SIZE_T)1 << (msb - 2);
+        return (r + step - 1) & ~(step - 1);
+    }
+
+    static void* Reserve(SIZE_T reserved, bool* arena) {
+        void* base = HighVAAPI::IsActive() ? HighVAAPI::Reserve(reserved) : nullptr;
+        *arena = base != nullptr;
+        if (!base) {
+            DWORD td = HighVAAPI::EffectiveLAA() ? MEM_TOP_DOWN : 0;
+            base = VirtualAlloc(nullptr, reserved, MEM_RESERVE | td, PAGE_NOACCESS);
+        }
+        return base;
+    }
+    static bool Commit(void* addr, SIZE_T size, bool arena) {
+        if (arena) return HighVAAPI::Commit(addr, size, PAGE_READWRITE);
+        return VirtualAlloc(addr, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+    }
+    static void ReleaseRegion(uintptr_t base, SIZE_T reserved, bool arena) {
+        OwnerRegistry::Clear((void*)base, reserved);
+        if (arena && HighVAAPI::Release((void*)base)) return;
+        VirtualFree((void*)base, 0, MEM_RELEASE);
+    }
+
+    // Adjusts the committed prefix of [base, base + reserved) to cover size. Must hold the lock.
+    static bool Resize(uintptr_t base, Block& b, SIZE_T size) {
+        SIZE_T need = HV_AlignUp(size, kPage);
+        if (need > b.committed) {
+            if (!Commit((void*)(base + b.committed), need - b.committed, b.arena)) return false;
+        } else if (need < b.committed) {
+            VirtualFree((void*)(base + need), b.committed - need, MEM_DECOMMIT);
+        }
+        g_stats.live_bytes += size; g_stats.live_bytes -= b.size;
+        b.committed = need;
+        b.size = size;
+        return true;
+    }
+
+    void Init(const Options& opt) {
+        Lock l;
+        g_opt = opt;
+    }
+
+    void* Alloc(SIZE_T size, bool zero) {
+        if (!size) return nullptr;
+        SIZE_T reserved = ClassSize(size);
+        if (reserved < size) return nullptr;
+        Lock l;
+        Block b{ 0, reserved, 0, false };
+        uintptr_t base = 0;
+        bool dirty = false;
+        auto it = g_cache.find(reserved);
+        if (it != g_cache.end() && !it->second.empty()) {
+            Cached c = it->second.back(); it->second.pop_back();
+            g_stats.cached_blocks--; g_stats.cached_bytes -= c.committed;
+            base = c.base; b.committed = c.committed; b.arena = c.arena;
+            dirty = true;
+            g_stats.reused++;
+        } else {
+            base = (uintptr_t)Reserve(reserved, &b.arena);
+            if (!base) return nullptr;
+            OwnerRegistry::Mark((void*)base, reserved, OwnerRegistry::kBig);
+        }
+        SIZE_T reusedBytes = b.committed;
+        if (!Resize(base, b, size)) { ReleaseRegion(base, reserved, b.arena); return nullptr; }
+        // Fresh pages are zero, only the part reused from a cached block needs clearing
+        if (zero && dirty) memset((void*)base, 0, (size < reusedBytes) ? size : reusedBytes);
+        g_blocks[base] = b;
+        g_stats.live_blocks++;
+        return (void*)base;
+    }
+
+    void Free(void* p) {
+        Lock l;
+        auto it = g_blocks.find((uintptr_t)p);
+        if (it == g_blocks.end()) return;
+        Block b = it->second;
+        g_blocks.erase(it);
+        g_stats.live_blocks--; g_stats.live_bytes -= b.size;
+        if (g_stats.cached_bytes + b.committed <= g_opt.cache_bytes) {
+            g_cache[b.reserved].push_back({ (uintptr_t)p, b.committed, b.arena, GetTickCount() });
+            g_stats.cached_blocks++; g_stats.cached_bytes += b.committed;
+            return;
+        }
+        ReleaseRegion((uintptr_t)p, b.reserved, b.arena);
+    }
+
+    void* Realloc(void* p, SIZE_T size) {
+        if (!p) return Alloc(size, false);
+        SIZE_T old;
+        {
+            Lock l;
+            auto it = g_blocks.find((uintptr_t)p);
+            if (it == g_blocks.end()) return nullptr;
+            // Stay in place unless the block would fit a reservation of half the size or less
+            if (size && size <= it->second.reserved && size > it->second.reserved / 2) {
+                if (!Resize((uintptr_t)p, it->second, size)) return nullptr;
+                g_stats.in_place++;
+                return p;
+            }
+            old = it->second.size;
+        }
+        void* np = Alloc(size, false);
+        if (!np) return nullptr;
+        memcpy(np, p, (size < old) ? size : old);
+        Free(p);
+        return np;
+    }
+
+    SIZE_T Size(const void* p) {
+        AcquireSRWLockShared(&g_lock);
+        auto it = g_blocks.find((uintptr_t)p);
+        SIZE_T s = (it != g_blocks.end()) ? it->second.size : 0;
+        ReleaseSRWLockShared(&g_lock);
+        return s;
+    }
+
+    void Trim(DWORD maxAgeMs) {
+        Lock l;
+        DWORD now = GetTickCount();
+        for (auto& cls : g_cache) {
+            auto& v = cls.second;
+            size_t keep = 0;
+            for (size_t i = 0; i < v.size(); ++i) {
+                if (maxAgeMs && now - v[i].tick < maxAgeMs) { v[keep++] = v[i]; continue; }
+                ReleaseRegion(v[i].base, cls.first, v[i].arena);
+                g_stats.cached_blocks--; g_stats.cached_bytes -= v[i].committed;
+            }
+            v.resize(keep);
+        }
+    }
+
+    void GetStats(Stats* out) {
+        AcquireSRWLockShared(&g_lock);
+        *out = g_stats;
+        ReleaseSRWLockShared(&g_lock);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <stdint.h>
+
+static_assert(sizeof(void*) == 4, "This code targets 32-bit processes.");
+
+// Big-block allocator for CRT requests at or above LargeAllocThresholdMB. Each block is its own
+// reservation, placed in the high VA arena when it is active, with the user pointer at the start of the
+// reservation (64KB aligned) and the block size kept in a side table. Reservations are rounded up to
+// size classes of a quarter power of two and only the requested pages are committed, so a realloc
+// within the class grows or shrinks in place. Freed reservations are cached per class, still committed,
+// up to a byte limit and reused by later allocations of the same class.
+namespace BigBlocks {
+    struct Options {
+        SIZE_T cache_bytes = 64 * 1024 * 1024; // committed bytes of freed blocks kept for reuse (0=off)
+    };
+    struct Stats {
+        SIZE_T live_blocks, live_bytes, cached_blocks, cached_bytes;
+        LONG   reused, in_place;
+    };
+
+    void Init(const Options& opt);
+
+    // Returns nullptr on failure, the caller falls back to rpmalloc
+    void*  Alloc(SIZE_T size, bool zero);
+    void   Free(void* p);
+    // Resizes in place when the reservation allows it, otherwise moves. nullptr on failure, p stays valid
+    void*  Realloc(void* p, SIZE_T size);
+    // Requested size of a live block, 0 if p is not one
+    SIZE_T Size(const void* p);
+
+    // Releases cached reservations unused for at least maxAgeMs (0 releases all)
+    void   Trim(DWORD maxAgeMs);
+    void   GetStats(Stats* out);
+}
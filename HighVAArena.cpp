@@ -113,6 +113,28 @@ bool HighVAArena::carve_from_free_locked(size_t need_units, size_t& out_start_un
     return false;
 }
 
+bool HighVAArena::carve_aligned_from_free_locked(size_t need_units, SIZE_T alignment, size_t& out_start_units) {
+    // first-fit on the first aligned address inside each free segment; the unaligned head stays free
+    for (size_t i = 0; i < free_.size(); ++i) {
+        auto& f = free_[i];
+        uintptr_t seg_addr = base_ + f.start_units * gran_;
+        size_t head_units = (HV_AlignUp(seg_addr, alignment) - seg_addr) / gran_;
+        if (f.len_units < head_units + need_units) continue;
+        out_start_units = f.start_units + head_units;
+        FreeSeg tail{ out_start_units + need_units, f.len_units - head_units - need_units };
+        if (head_units) {
+            f.len_units = head_units;
+            if (tail.len_units) free_.insert(free_.begin() + i + 1, tail);
+        } else if (tail.len_units) {
+            f = tail;
+        } else {
+            free_.erase(free_.begin() + i);
+        }
+        return true;
+    }
+    return false;
+}
+
 void* HighVAArena::reserve(SIZE_T size) {
     if (!reserved_ok_) return nullptr;
     std::lock_guard<std::mutex> g(m_);
@@ -124,6 +146,18 @@ void* HighVAArena::reserve(SIZE_T size) {
     return addr;
 }
 
+void* HighVAArena::reserve_aligned(SIZE_T size, SIZE_T alignment) {
+    if (alignment <= gran_) return reserve(size);
+    if (!reserved_ok_) return nullptr;
+    std::lock_guard<std::mutex> g(m_);
+    size_t need_units = (HV_AlignUp(size, gran_)) / gran_;
+    size_t start_units = 0;
+    if (!carve_aligned_from_free_locked(need_units, alignment, start_units)) return nullptr;
+    void* addr = reinterpret_cast<void*>(base_ + start_units * gran_);
+    reserved_.emplace(addr, Reservation{ start_units, need_units });
+    return addr;
+}
+
 bool HighVAArena::commit(void* addr, SIZE_T size, DWORD protect) {
     if (!reserved_ok_ || !addr || size == 0) return false;
     uintptr_t u = reinterpret_cast<uintptr_t>(addr);
@@ -189,6 +223,7 @@ namespace HighVAAPI {
     bool Contains(void* p) { return g_arena.contains(p); }
 
     void* Reserve(SIZE_T size) { return g_arena.reserve(size); }
+    void* ReserveAligned(SIZE_T size, SIZE_T alignment) { return g_arena.reserve_aligned(size, alignment); }
     bool  Commit(void* addr, SIZE_T size, DWORD protect) { return g_arena.commit(addr, size, protect); }
     void* Alloc(SIZE_T size, DWORD protect) { return g_arena.alloc(size, protect); }
 
@@ -57,6 +57,7 @@ public:
     void destroy();
 
     void* reserve(SIZE_T size);
+    void* reserve_aligned(SIZE_T size, SIZE_T alignment);
     bool  commit(void* addr, SIZE_T size, DWORD protect);
     void* alloc(SIZE_T size, DWORD protect);
     bool  decommit(void* addr, SIZE_T size);
@@ -77,6 +78,7 @@ private:
     bool try_reserve_high(SIZE_T size);
     void merge_free_locked(FreeSeg seg);
     bool carve_from_free_locked(size_t need_units, size_t& out_start_units);
+    bool carve_aligned_from_free_locked(size_t need_units, SIZE_T alignment, size_t& out_start_units);
 
     mutable std::mutex m_;
     uintptr_t base_ = 0;
@@ -98,6 +100,7 @@ namespace HighVAAPI {
 
     // Allocation/commit helpers (used by VirtualAlloc hook)
     void* Reserve(SIZE_T size);
+    void* ReserveAligned(SIZE_T size, SIZE_T alignment);
     bool  Commit(void* addr, SIZE_T size, DWORD protect);
     void* Alloc(SIZE_T size, DWORD protect);
 
@@ -0,0 +1,168 @@
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <psapi.h>
+#include <stdint.h>
+#include <algorithm>
+#include "MismatchTracker.h"
+
+namespace MismatchTracker {
+    uint32_t g_sampleMask = 0;
+
+    // Slot keys: 0 empty, 1 deleted, 2 being written, otherwise the block address. A writer claims an
+    // empty or deleted slot (or the stale record of the same address) by swapping in kBusy, fills it and
+    // publishes the address last. Deleted slots are reused but never become empty again, so a lookup
+    // scans the whole probe window. Records of blocks freed behind the hooks' back are overwritten when
+    // the address is handed out again.
+    static const LONG kEmpty = 0, kDeleted = 1, kBusy = 2;
+    static const unsigned kTableBits = 16;
+    static const uint32_t kTableMask = (1u << kTableBits) - 1;
+    static const unsigned kProbe = 16;
+
+    struct Slot { volatile LONG key; HMODULE mod; size_t size; };
+    static Slot* g_slots = nullptr;
+    static Stats g_stats = {};
+
+    static inline uint32_t SlotIndex(const void* p) {
+        return ((uint32_t)(uintptr_t)p * 0x9E3779B1u) >> (32 - kTableBits);
+    }
+
+    // Module ranges, sorted by base. On a lookup miss the loaded module set is checked, at most once a
+    // second, and the table is only rebuilt if the set changed. Addresses outside every module (thunks,
+    // code caves, unloaded modules) are remembered per 4KB page until the next rebuild so they do not
+    // trigger the check again. Replaced tables are freed after a grace period, readers only hold a table
+    // for the duration of one binary search.
+    struct ModuleRange { uintptr_t base, end; HMODULE mod; };
+    struct ModuleTable { DWORD count; uint32_t signature; ModuleTable* retired; DWORD retireTick; ModuleRange range[1]; };
+    static ModuleTable* volatile g_modules = nullptr;
+    static ModuleTable* g_retired = nullptr; // replaced tables, newest first, under g_modulesLock
+    static SRWLOCK g_modulesLock = SRWLOCK_INIT;
+    static volatile DWORD g_modulesTick = 0;
+    static const DWORD kRetireGraceMs = 10000;
+    static const unsigned kMissSlots = 256;
+    static volatile LONG g_missPages[kMissSlots]; // page number + 1 of addresses outside every module
+
+    static inline volatile LONG* MissSlot(uintptr_t page) { return &g_missPages[((uint32_t)page * 0x9E3779B1u) >> 24]; }
+
+    static void RefreshModules(DWORD now) {
+        HMODULE mods[1024]; DWORD needed = 0; HANDLE proc = GetCurrentProcess();
+        if (!EnumProcessModules(proc, mods, sizeof(mods), &needed)) return;
+        DWORD cnt = (std::min)(needed / (DWORD)sizeof(HMODULE), (DWORD)(sizeof(mods) / sizeof(mods[0])));
+        uint32_t sig = cnt;
+        for (DWORD i = 0; i < cnt; ++i) sig = ((sig << 5) | (sig >> 27)) ^ (uint32_t)(uintptr_t)mods[i];
+        ModuleTable* cur = g_modules;
+        if (cur && cur->signature == sig) return;
+        ModuleTable* t = (ModuleTable*)HeapAlloc(GetProcessHeap(), 0, sizeof(ModuleTable) + cnt * sizeof(ModuleRange));
+        if (!t) return;
+        DWORD n = 0;
+        for (DWORD i = 0; i < cnt; ++i) {
+            MODULEINFO mi{};
+            if (!GetModuleInformation(proc, mods[i], &mi, sizeof(mi))) continue;
+            t->range[n].base = (uintptr_t)mi.lpBaseOfDll;
+            t->range[n].end = (uintptr_t)mi.lpBaseOfDll + mi.SizeOfImage;
+            t->range[n].mod = mods[i];
+            ++n;
+        }
+        t->count = n;
+        t->signature = sig;
+        t->retired = nullptr;
+        std::sort(t->range, t->range + n, [](const ModuleRange& a, const ModuleRange& b) { return a.base < b.base; });
+        InterlockedExchangePointer((PVOID volatile*)&g_modules, t);
+        for (unsigned i = 0; i < kMissSlots; ++i) g_missPages[i] = 0;
+        if (cur) { cur->retireTick = now; cur->retired = g_retired; g_retired = cur; }
+        // Free tables replaced long enough ago, the list is newest first
+        for (ModuleTable** link = &g_retired; *link; link = &(*link)->retired) {
+            if (now - (*link)->retireTick < kRetireGraceMs) continue;
+            ModuleTable* old = *link;
+            *link = nullptr;
+            while (old) { ModuleTable* next = old->retired; HeapFree(GetProcessHeap(), 0, old); old = next; }
+            break;
+        }
+    }
+
+    static HMODULE FindModule(const ModuleTable* t, uintptr_t a) {
+        if (!t) return nullptr;
+        DWORD lo = 0, hi = t->count;
+        while (lo < hi) {
+            DWORD mid = (lo + hi) / 2;
+            if (t->range[mid].base <= a) lo = mid + 1; else hi = mid;
+        }
+        return (lo && a < t->range[lo - 1].end) ? t->range[lo - 1].mod : nullptr;
+    }
+
+    HMODULE ModuleOf(const void* addr) {
+        HMODULE m = FindModule(g_modules, (uintptr_t)addr);
+        if (m) return m;
+        uintptr_t page = (uintptr_t)addr >> 12;
+        volatile LONG* miss = MissSlot(page);
+        if (*miss == (LONG)(page + 1)) return nullptr;
+        DWORD now = GetTickCount();
+        if (now - g_modulesTick >= 1000 && TryAcquireSRWLockExclusive(&g_modulesLock)) {
+            g_modulesTick = now;
+            RefreshModules(now);
+            m = FindModule(g_modules, (uintptr_t)addr);
+            if (!m) *miss = (LONG)(page + 1);
+            ReleaseSRWLockExclusive(&g_modulesLock);
+        }
+        return m;
+    }
+
+    bool Init(uint32_t sampleRate) {
+        if (g_slots) return true;
+        uint32_t rate = 1;
+        while (rate < sampleRate && rate < 4096) rate <<= 1;
+        g_sampleMask = rate - 1;
+        g_slots = (Slot*)VirtualAlloc(nullptr, sizeof(Slot) << kTableBits, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (!g_slots) return false;
+        AcquireSRWLockExclusive(&g_modulesLock);
+        g_modulesTick = GetTickCount();
+        RefreshModules(g_modulesTick);
+        ReleaseSRWLockExclusive(&g_modulesLock);
+        return true;
+    }
+
+    void OnAlloc(void* p, size_t size, void* caller) {
+        if (!g_slots) return;
+        HMODULE mod = ModuleOf(caller);
+        uint32_t idx = SlotIndex(p);
+        Slot* slot = nullptr;
+        for (unsigned i = 0; i < kProbe && !slot; ++i) {
+            Slot* s = &g_slots[(idx + i) & kTableMask];
+            LONG k = s->key;
+            if (k == kEmpty) break;
+            if (k == (LONG)(uintptr_t)p && InterlockedCompareExchange(&s->key, kBusy, k) == k) slot = s;
+        }
+        for (unsigned i = 0; i < kProbe && !slot; ++i) {
+            Slot* s = &g_slots[(idx + i) & kTableMask];
+            LONG k = s->key;
+            if ((k == kEmpty || k == kDeleted) && InterlockedCompareExchange(&s->key, kBusy, k) == k) slot = s;
+        }
+        if (!slot) { InterlockedIncrement(&g_stats.dropped); return; }
+        slot->mod = mod;
+        slot->size = size;
+        InterlockedExchange(&slot->key, (LONG)(uintptr_t)p);
+        InterlockedIncrement(&g_stats.tracked);
+    }
+
+    bool OnFree(void* p, void* caller, Record* alloc, HMODULE* freeMod) {
+        if (!g_slots) return false;
+        uint32_t idx = SlotIndex(p);
+        for (unsigned i = 0; i < kProbe; ++i) {
+            Slot* s = &g_slots[(idx + i) & kTableMask];
+            LONG k = s->key;
+            if (k == kEmpty) return false;
+            if (k != (LONG)(uintptr_t)p) continue;
+            Record r = { s->mod, s->size };
+            if (InterlockedCompareExchange(&s->key, kDeleted, k) != k) return false;
+            HMODULE fm = ModuleOf(caller);
+            if (!r.mod || !fm || r.mod == fm) return false;
+            InterlockedIncrement(&g_stats.mismatches);
+            *alloc = r; *freeMod = fm;
+            return true;
+        }
+        return false;
+    }
+
+    void GetStats(Stats* out) {
+        *out = g_stats;
+    }
+}
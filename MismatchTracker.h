@@ -0,0 +1,37 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <stdint.h>
+
+static_assert(sizeof(void*) == 4, "This code targets 32-bit processes.");
+
+// Cross-module free detection for the CRT hooks. A sample of the allocations, picked by a hash of the
+// block address, is recorded with the module that called malloc in a fixed lock-free open addressing
+// table. A free of a sampled block looks the record up and reports it when the freeing module differs.
+// Caller modules are resolved from return addresses with a cached sorted table of module ranges, so
+// neither side walks the stack or takes a lock. Unsampled blocks cost one multiply on each side.
+namespace MismatchTracker {
+    struct Record { HMODULE mod; size_t size; };
+    struct Stats { LONG tracked; LONG dropped; LONG mismatches; };
+
+    extern uint32_t g_sampleMask;
+
+    // Allocates the table and snapshots the loaded modules. sampleRate is rounded up to a power of two,
+    // 1 tracks every block. Returns false (tracking stays off) if the table cannot be mapped.
+    bool Init(uint32_t sampleRate);
+
+    inline bool Sampled(const void* p) {
+        return ((((uint32_t)(uintptr_t)p >> 4) * 0x85EBCA6Bu) >> 20 & g_sampleMask) == 0;
+    }
+
+    // Callers check Sampled() first. caller is the hook's return address.
+    void OnAlloc(void* p, size_t size, void* caller);
+    // Drops the record of p. Returns true and fills the allocation record and freeing module if p was
+    // allocated by a different module than the one freeing it.
+    bool OnFree(void* p, void* caller, Record* alloc, HMODULE* freeMod);
+
+    // Module containing addr, nullptr if none
+    HMODULE ModuleOf(const void* addr);
+
+    void GetStats(Stats* out);
+}
@@ -32,13 +32,16 @@ bool LoadOverdriveConfig(OverdriveConfig& c) {
     // General
     c.useVanillaHeaps = ReadInt(iniPath, "General", "bUseVanillaHeaps", c.useVanillaHeaps ? 1 : 0) != 0;
     c.budgetPreset = ReadInt(iniPath, "General", "iBudgetPreset", c.budgetPreset);
+    // The shipped INI lists the mismatch keys under [Hooks], [General] is still honoured
     c.detectCrossModuleMismatch = ReadInt(iniPath, "General", "bDetectCrossModuleMismatch", c.detectCrossModuleMismatch ? 1 : 0) != 0;
-    c.stackTraceDepth = (uint32_t)ReadInt(iniPath, "General", "iStackTraceDepth", (int)c.stackTraceDepth);
+    c.detectCrossModuleMismatch = ReadInt(iniPath, "Hooks", "bDetectCrossModuleMismatch", c.detectCrossModuleMismatch ? 1 : 0) != 0;
+    c.mismatchSampleRate = (uint32_t)ReadInt(iniPath, "Hooks", "iMismatchSampleRate", (int)c.mismatchSampleRate);
 
     // Address space / arena
     c.enableArena = ReadInt(iniPath, "AddressSpace", "bEnableArena", c.enableArena ? 1 : 0) != 0;
     c.arenaMB = (uint32_t)ReadInt(iniPath, "AddressSpace", "iArenaMB", (int)c.arenaMB);
     c.topDownOnNonArena = ReadInt(iniPath, "AddressSpace", "bTopDownOnNonArena", c.topDownOnNonArena ? 1 : 0) != 0;
+    c.rpmallocInArena = ReadInt(iniPath, "AddressSpace", "bRpmallocInArena", c.rpmallocInArena ? 1 : 0) != 0;
 
     // Custom budgets (MB)
     c.exteriorTextureMB = ReadInt(iniPath, "Budgets", "ExteriorTextureMB", c.exteriorTextureMB);
@@ -89,9 +92,24 @@ bool LoadOverdriveConfig(OverdriveConfig& c) {
     c.hookChainExisting = ReadInt(iniPath, "Hooks", "bHookChainExisting", c.hookChainExisting ? 1 : 0) != 0;
     ReadString(iniPath, "Hooks", "sHookWhitelist", "", c.hookWhitelist, (DWORD)sizeof(c.hookWhitelist));
     c.largeAllocThresholdMB = (uint32_t)ReadInt(iniPath, "Hooks", "LargeAllocThresholdMB", (int)c.largeAllocThresholdMB);
+    c.bigBlockCacheMB = (uint32_t)ReadInt(iniPath, "Hooks", "iBigBlockCacheMB", (int)c.bigBlockCacheMB);
+
+    // Allocator
+    c.spanGeometry = (uint32_t)ReadInt(iniPath, "Allocator", "iSpanGeometry", (int)c.spanGeometry);
+    c.collectPeriodFrames = (uint32_t)ReadInt(iniPath, "Allocator", "iCollectPeriodFrames", (int)c.collectPeriodFrames);
+    c.hugeCacheMB = (uint32_t)ReadInt(iniPath, "Allocator", "iHugeCacheMB", (int)c.hugeCacheMB);
+    c.pressureVAMB = (uint32_t)ReadInt(iniPath, "Allocator", "iPressureVAMB", (int)c.pressureVAMB);
+    c.pressureCommitMB = (uint32_t)ReadInt(iniPath, "Allocator", "iPressureCommitMB", (int)c.pressureCommitMB);
+    c.scavengeMBPerSec = (uint32_t)ReadInt(iniPath, "Allocator", "iScavengeMBPerSec", (int)c.scavengeMBPerSec);
+    c.scavengeAgeMs = (uint32_t)ReadInt(iniPath, "Allocator", "iScavengeAgeMs", (int)c.scavengeAgeMs);
+    c.threadCacheKB[0] = (uint32_t)ReadInt(iniPath, "Allocator", "iThreadCacheSmallKB", (int)c.threadCacheKB[0]);
+    c.threadCacheKB[1] = (uint32_t)ReadInt(iniPath, "Allocator", "iThreadCacheMediumKB", (int)c.threadCacheKB[1]);
+    c.threadCacheKB[2] = (uint32_t)ReadInt(iniPath, "Allocator", "iThreadCacheLargeKB", (int)c.threadCacheKB[2]);
+    c.threadIdleTrimSec = (uint32_t)ReadInt(iniPath, "Allocator", "iThreadIdleTrimSec", (int)c.threadIdleTrimSec);
 
     // Telemetry
     c.telemetryEnabled = ReadInt(iniPath, "Telemetry", "bEnabled", c.telemetryEnabled ? 1 : 0) != 0;
+    c.countAllocations = ReadInt(iniPath, "Telemetry", "bCountAllocations", c.countAllocations ? 1 : 0) != 0;
     c.telemetryPeriodFrames = (uint32_t)ReadInt(iniPath, "Telemetry", "iPeriodFrames", (int)c.telemetryPeriodFrames);
     ReadString(iniPath, "Telemetry", "sOutput", c.telemetryFile, c.telemetryFile, (DWORD)sizeof(c.telemetryFile));
 
@@ -8,12 +8,13 @@ struct OverdriveConfig {
     int budgetPreset = 2; // aggressive preset by default for performance
     // Diagnostics
     bool detectCrossModuleMismatch = false;
-    uint32_t stackTraceDepth = 12; // for mismatch logging
+    uint32_t mismatchSampleRate = 16; // track 1 in N blocks for mismatch detection (power of two, 1=all)
 
     // High VA arena
     bool enableArena = true;
     uint32_t arenaMB = 1024; // 1GB default
     bool topDownOnNonArena = true; // steer non-arena reserves top-down when effective LAA
+    bool rpmallocInArena = true; // map rpmalloc spans from the arena
 
     // Custom budgets (MB); if zero, ignored when preset != custom
     uint32_t exteriorTextureMB = 0;
@@ -67,11 +68,24 @@ struct OverdriveConfig {
 
     // Telemetry
     bool telemetryEnabled = true;
+    bool countAllocations = true; // per-call alloc/free counters in the hooks, read at startup only
     uint32_t telemetryPeriodFrames = 300; // ~5s @60fps
     char telemetryFile[MAX_PATH] = "Data\\NVSE\\Plugins\\OverdriveMetrics.csv";
 
     // Allocation tuning
     uint32_t largeAllocThresholdMB = 8; // > threshold -> direct VirtualAlloc
+    uint32_t bigBlockCacheMB = 64; // freed big blocks kept reserved and committed for reuse (0=off)
+
+    // rpmalloc
+    uint32_t spanGeometry = 0; // 0=auto (compact on 32-bit), 1=256MB spans, 2=compact 4MB spans
+    uint32_t collectPeriodFrames = 60; // reclaim cross-thread frees on the main thread every N frames (0=off)
+    uint32_t hugeCacheMB = 64; // VA held by freed rpmalloc huge blocks kept for reuse (0=off)
+    uint32_t pressureVAMB = 384; // free VA below which rpmalloc retains fewer free pages (0=off)
+    uint32_t pressureCommitMB = 512; // commit headroom below which rpmalloc retains fewer free pages (0=off)
+    uint32_t scavengeMBPerSec = 32; // background decommit budget for idle free pages (0=decommit inline on free)
+    uint32_t scavengeAgeMs = 1000; // free pages younger than this are left committed
+    uint32_t threadCacheKB[3] = {0, 0, 0}; // committed free small/medium/large pages kept per thread (0=rpmalloc default)
+    uint32_t threadIdleTrimSec = 5; // free pages of threads idle this long go to the global cache (0=off)
 };
 
 bool LoadOverdriveConfig(OverdriveConfig& outCfg);
@@ -0,0 +1,84 @@
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <stdint.h>
+#include "rpmalloc.h"
+#include "OverdriveHeap.h"
+
+static_assert(RPMALLOC_FIRST_CLASS_HEAPS, "OverdriveHeap needs rpmalloc built with RPMALLOC_FIRST_CLASS_HEAPS=1");
+
+namespace OverdriveHeap {
+    struct Heap {
+        SRWLOCK lock;
+        rpmalloc_heap_t* rp;
+    };
+
+    struct Guard {
+        Heap* h;
+        explicit Guard(Heap* heap) : h(heap) { AcquireSRWLockExclusive(&h->lock); }
+        ~Guard() { ReleaseSRWLockExclusive(&h->lock); }
+    };
+
+    Heap* Create() {
+        if (!rpmalloc_config()->page_size) return nullptr;
+        Heap* h = (Heap*)rpmalloc(sizeof(Heap));
+        if (!h) return nullptr;
+        InitializeSRWLock(&h->lock);
+        h->rp = rpmalloc_heap_acquire();
+        if (!h->rp) { rpfree(h); return nullptr; }
+        return h;
+    }
+
+    void Destroy(Heap* heap) {
+        if (!heap) return;
+        {
+            Guard g(heap);
+            rpmalloc_heap_free_all(heap->rp);
+            rpmalloc_heap_release(heap->rp);
+            heap->rp = nullptr;
+        }
+        rpfree(heap);
+    }
+
+    void* Alloc(Heap* heap, size_t size, bool zero) {
+        Guard g(heap);
+        return zero ? rpmalloc_heap_calloc(heap->rp, 1, size) : rpmalloc_heap_alloc(heap->rp, size);
+    }
+
+    void* Realloc(Heap* heap, void* p, size_t size, unsigned flags) {
+        Guard g(heap);
+        return rpmalloc_heap_realloc(heap->rp, p, size, flags);
+    }
+
+    void Free(Heap* heap, void* p) {
+        if (!p) return;
+        Guard g(heap);
+        rpmalloc_heap_free(heap->rp, p);
+    }
+
+    size_t Size(const void* p) {
+        return p ? rpmalloc_usable_size((void*)p) : 0;
+    }
+
+    void FreeAll(Heap* heap) {
+        Guard g(heap);
+        rpmalloc_heap_free_all(heap->rp);
+    }
+
+    void Compact(Heap* heap) {
+        Guard g(heap);
+        rpmalloc_heap_collect(heap->rp);
+    }
+}
+
+using namespace OverdriveHeap;
+
+extern "C" {
+    void*  OverdriveHeapCreate() { return Create(); }
+    void   OverdriveHeapDestroy(void* heap) { Destroy((Heap*)heap); }
+    void*  OverdriveHeapAlloc(void* heap, size_t size) { return heap ? Alloc((Heap*)heap, size, false) : nullptr; }
+    void*  OverdriveHeapCalloc(void* heap, size_t size) { return heap ? Alloc((Heap*)heap, size, true) : nullptr; }
+    void*  OverdriveHeapRealloc(void* heap, void* p, size_t size) { return heap ? Realloc((Heap*)heap, p, size, 0) : nullptr; }
+    void   OverdriveHeapFree(void* heap, void* p) { if (heap) Free((Heap*)heap, p); }
+    size_t OverdriveHeapSize(const void* p) { return Size(p); }
+    void   OverdriveHeapFreeAll(void* heap) { if (heap) FreeAll((Heap*)heap); }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <stdint.h>
+
+// Private heaps over rpmalloc first class heaps. Calls on one heap are serialized by the heap's own lock,
+// so a heap can be shared between threads like a Win32 heap. Destroy/FreeAll drop every block by
+// unmapping the heap's spans (O(spans)) instead of freeing blocks one by one. Blocks may also be freed
+// through the generic rpfree/free hooks from any thread, they are handed back to the heap atomically.
+namespace OverdriveHeap {
+    struct Heap;
+
+    // Returns nullptr until rpmalloc is initialized (or in vanilla heap mode)
+    Heap* Create();
+    // Frees every block of the heap and the heap itself
+    void  Destroy(Heap* heap);
+
+    void* Alloc(Heap* heap, size_t size, bool zero);
+    // flags are RPMALLOC_* realloc flags, RPMALLOC_GROW_OR_FAIL returns nullptr unless grown in place
+    void* Realloc(Heap* heap, void* p, size_t size, unsigned flags);
+    void  Free(Heap* heap, void* p);
+    size_t Size(const void* p);
+    // Frees every block of the heap, the heap stays usable
+    void  FreeAll(Heap* heap);
+    // Takes back blocks freed through rpfree or by other threads and releases empty pages
+    void  Compact(Heap* heap);
+}
+
+// C interface for other NVSE plugins, resolve with GetProcAddress on the Overdrive DLL
+extern "C" {
+    __declspec(dllexport) void*  OverdriveHeapCreate();
+    __declspec(dllexport) void   OverdriveHeapDestroy(void* heap);
+    __declspec(dllexport) void*  OverdriveHeapAlloc(void* heap, size_t size);
+    __declspec(dllexport) void*  OverdriveHeapCalloc(void* heap, size_t size);
+    __declspec(dllexport) void*  OverdriveHeapRealloc(void* heap, void* p, size_t size);
+    __declspec(dllexport) void   OverdriveHeapFree(void* heap, void* p);
+    __declspec(dllexport) size_t OverdriveHeapSize(const void* p);
+    __declspec(dllexport) void   OverdriveHeapFreeAll(void* heap);
+}
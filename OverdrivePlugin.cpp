@@ -18,6 +18,10 @@
 #include "performance_patcher.h"
 #include "virtualfree_hook.h"
 #include "HighVAArena.h"
+#include "OwnershipRegistry.h"
+#include "MismatchTracker.h"
+#include "BigBlocks.h"
+#include "OverdriveHeap.h"
 
 // Enhanced logging system
 static CRITICAL_SECTION g_log_cs;
@@ -161,9 +165,74 @@ void LogWrite(int level, const char* file, int line, const char* fmt, ...) {
 // Config and telemetry
 static OverdriveConfig g_cfg{};
 static volatile LONG g_initialized = 0;
-static volatile LONG64 g_allocs = 0, g_frees = 0, g_bytes_alloc = 0, g_bytes_free = 0;
 static volatile LONG g_frame = 0;
 
+// Allocation counters, one cache line shard per thread so the hooks never write a shared line. A thread takes
+// a shard on its first counted call, readers sum all shards (a 64-bit field may read torn on 32-bit, which
+// only skews a sample). An FLS callback folds the shard into the retired totals when the thread exits and
+// returns it for reuse, so only more than 256 live threads fall back to the overflow shard, which is shared
+// with interlocked adds.
+struct alignas(64) CounterShard { LONG64 allocs, frees, bytes_alloc, bytes_free; };
+struct CounterTotals { LONG64 allocs, frees, bytes_alloc, bytes_free; };
+static const LONG kCounterShards = 256;
+static CounterShard g_counterShards[kCounterShards + 1];
+static CounterShard* const g_counterOverflow = &g_counterShards[kCounterShards];
+static volatile LONG g_counterShardNext = 0;
+static __declspec(thread) CounterShard* t_counterShard = nullptr;
+static SRWLOCK g_counterLock = SRWLOCK_INIT; // shard assignment, free list and retired totals
+static LONG g_counterFree[kCounterShards];
+static LONG g_counterFreeCount = 0;
+static CounterTotals g_counterRetired{};
+static DWORD g_counterFls = FLS_OUT_OF_INDEXES;
+
+static void WINAPI CounterShardRelease(void* p) {
+    // Runs on the exiting thread, or on the thread deleting a fiber. Only the owning thread may recycle
+    CounterShard* s = (CounterShard*)p;
+    if (!s || s != t_counterShard) return;
+    t_counterShard = g_counterOverflow; // counted calls from later detach notifications
+    AcquireSRWLockExclusive(&g_counterLock);
+    g_counterRetired.allocs += s->allocs; g_counterRetired.frees += s->frees;
+    g_counterRetired.bytes_alloc += s->bytes_alloc; g_counterRetired.bytes_free += s->bytes_free;
+    s->allocs = s->frees = s->bytes_alloc = s->bytes_free = 0;
+    g_counterFree[g_counterFreeCount++] = (LONG)(s - g_counterShards);
+    ReleaseSRWLockExclusive(&g_counterLock);
+}
+static void CounterShardsInit() {
+    if (g_counterFls == FLS_OUT_OF_INDEXES) g_counterFls = FlsAlloc(CounterShardRelease);
+    if (g_counterFls == FLS_OUT_OF_INDEXES) LOGW("FlsAlloc failed, counter shards are not recycled");
+}
+static __declspec(noinline) CounterShard* CounterShardAcquire() {
+    AcquireSRWLockExclusive(&g_counterLock);
+    LONG i = g_counterFreeCount ? g_counterFree[--g_counterFreeCount] : g_counterShardNext;
+    if (i == g_counterShardNext && i < kCounterShards) g_counterShardNext = i + 1;
+    ReleaseSRWLockExclusive(&g_counterLock);
+    // Publish before FlsSetValue, which may allocate its storage through a counted hook
+    t_counterShard = (i < kCounterShards) ? &g_counterShards[i] : g_counterOverflow;
+    if (t_counterShard != g_counterOverflow && g_counterFls != FLS_OUT_OF_INDEXES) FlsSetValue(g_counterFls, t_counterShard);
+    return t_counterShard;
+}
+static inline void CountAlloc(size_t bytes) {
+    CounterShard* s = t_counterShard ? t_counterShard : CounterShardAcquire();
+    if (s != g_counterOverflow) { ++s->allocs; s->bytes_alloc += (LONG64)bytes; return; }
+    InterlockedIncrement64(&s->allocs); InterlockedExchangeAdd64(&s->bytes_alloc, (LONG64)bytes);
+}
+static inline void CountFree(size_t bytes) {
+    CounterShard* s = t_counterShard ? t_counterShard : CounterShardAcquire();
+    if (s != g_counterOverflow) { ++s->frees; s->bytes_free += (LONG64)bytes; return; }
+    InterlockedIncrement64(&s->frees); if (bytes) InterlockedExchangeAdd64(&s->bytes_free, (LONG64)bytes);
+}
+static CounterTotals ReadCounters() {
+    AcquireSRWLockShared(&g_counterLock);
+    CounterTotals t = g_counterRetired;
+    LONG used = g_counterShardNext;
+    for (LONG i = 0; i <= used; ++i) {
+        const volatile CounterShard& s = (i < used) ? g_counterShards[i] : *g_counterOverflow;
+        t.allocs += s.allocs; t.frees += s.frees; t.bytes_alloc += s.bytes_alloc; t.bytes_free += s.bytes_free;
+    }
+    ReleaseSRWLockShared(&g_counterLock);
+    return t;
+}
+
 // Baseline/current budgets for dynamic scaling
 static MemoryBudgetConfig g_budgetBase{};
 static MemoryBudgetConfig g_budgetCur{};
@@ -183,232 +252,374 @@ static void* (__cdecl* orig_realloc)(void*, size_t) = nullptr;
 static LPVOID (WINAPI* orig_HeapAlloc)(HANDLE, DWORD, SIZE_T) = nullptr;
 static LPVOID (WINAPI* orig_HeapReAlloc)(HANDLE, DWORD, LPVOID, SIZE_T) = nullptr;
 static BOOL   (WINAPI* orig_HeapFree)(HANDLE, DWORD, LPVOID) = nullptr;
+static HANDLE (WINAPI* orig_HeapCreate)(DWORD, SIZE_T, SIZE_T) = nullptr;
+static BOOL   (WINAPI* orig_HeapDestroy)(HANDLE) = nullptr;
+static SIZE_T (WINAPI* orig_HeapSize)(HANDLE, DWORD, LPCVOID) = nullptr;
+static BOOL   (WINAPI* orig_HeapValidate)(HANDLE, DWORD, LPCVOID) = nullptr;
+static SIZE_T (WINAPI* orig_HeapCompact)(HANDLE, DWORD) = nullptr;
+static BOOL   (WINAPI* orig_HeapWalk)(HANDLE, LPPROCESS_HEAP_ENTRY) = nullptr;
 static LPVOID (WINAPI* orig_VirtualAlloc)(LPVOID, SIZE_T, DWORD, DWORD) = nullptr;
 static SIZE_T g_largeThresholdBytes = 8 * 1024 * 1024; // configurable
 
-// Hybrid big allocation header
-struct BigHdr { uint32_t magic; uint32_t reserved; SIZE_T size; };
-static const uint32_t BIG_MAGIC = 0xB16B00B5u;
-static inline bool IsBigPtr(void* p) {
-    __try {
-        BigHdr* h = (BigHdr*)((uint8_t*)p - sizeof(BigHdr));
-        return h && h->magic == BIG_MAGIC;
-    } __except(EXCEPTION_EXECUTE_HANDLER) { return false; }
-}
-static void* BigAlloc(SIZE_T sz, bool zero) {
-    SIZE_T total = sz + sizeof(BigHdr);
-    DWORD at = MEM_RESERVE | MEM_COMMIT | (HighVAAPI::EffectiveLAA() ? MEM_TOP_DOWN : 0);
-    void* base = orig_VirtualAlloc ? orig_VirtualAlloc(nullptr, total, at, PAGE_READWRITE) : VirtualAlloc(nullptr, total, at, PAGE_READWRITE);
+// Big blocks (>= LargeAllocThresholdMB) bypass rpmalloc, see BigBlocks.h
+static const DWORD kBigBlockCacheAgeMs = 2000; // cached big blocks unused this long are released
+static inline bool IsBigPtr(void* p) { return OwnerRegistry::Lookup(p) == OwnerRegistry::kBig; }
+static inline bool IsRpmallocPtr(void* p) { return OwnerRegistry::Lookup(p) == OwnerRegistry::kRpmalloc; }
+
+// rpmalloc memory interface: carve spans from the high VA arena so allocator memory stays out of
+// the low 2GB, and tag every mapping in the ownership registry. Mappings are committed up front
+// since rpmalloc is built without decommit support, except the realloc headroom past huge blocks
+// which rpmalloc decommits after mapping and commits again as the block grows into it.
+static bool g_spansInArena = false;
+static void* SpanMapSystem(size_t size, size_t alignment, size_t* offset, size_t* mapped_size) {
+    // Reserve exactly the aligned range from the system, top-down when LAA
+    DWORD td = HighVAAPI::EffectiveLAA() ? MEM_TOP_DOWN : 0;
+    if (alignment <= 64 * 1024) return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | td, PAGE_READWRITE);
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        void* probe = VirtualAlloc(nullptr, size + alignment, MEM_RESERVE | td, PAGE_NOACCESS);
+        if (!probe) return nullptr;
+        uintptr_t aligned = HV_AlignUp((uintptr_t)probe, alignment);
+        VirtualFree(probe, 0, MEM_RELEASE);
+        void* p = VirtualAlloc((void*)aligned, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (p) return p;
+    }
+    // Other threads kept taking the aligned range, keep a padded reservation and commit the aligned part
+    uint8_t* base = (uint8_t*)VirtualAlloc(nullptr, size + alignment, MEM_RESERVE | td, PAGE_NOACCESS);
     if (!base) return nullptr;
-    BigHdr* h = (BigHdr*)base; h->magic = BIG_MAGIC; h->reserved = 0; h->size = sz;
-    void* user = (void*)((uint8_t*)base + sizeof(BigHdr));
-    if (zero && user) memset(user, 0, sz);
-    return user;
-}
-static void BigFree(void* p) {
-    BigHdr* h = (BigHdr*)((uint8_t*)p - sizeof(BigHdr));
-    VirtualFree(h, 0, MEM_RELEASE);
-}
-static void* BigRealloc(void* p, SIZE_T sz) {
-    if (!p) return BigAlloc(sz, false);
-    BigHdr* h = (BigHdr*)((uint8_t*)p - sizeof(BigHdr));
-    if (h->magic != BIG_MAGIC) return nullptr;
-    if (sz == h->size) return p;
-    void* np = BigAlloc(sz, false);
-    if (!np) return nullptr;
-    SIZE_T copy = (sz < h->size) ? sz : h->size;
-    memcpy(np, p, copy);
-    BigFree(p);
-    return np;
-}
-
-// Cross-module mismatch detection (optional)
-static CRITICAL_SECTION g_alloc_meta_lock;
-struct AllocMeta { HMODULE mod; void* trace[16]; USHORT depth; size_t size; };
-#include <unordered_map>
-static std::unordered_map<void*, AllocMeta> g_alloc_meta;
-static bool g_alloc_meta_inited = false;
-static void AllocMetaInit(){ if(!g_alloc_meta_inited){ InitializeCriticalSection(&g_alloc_meta_lock); g_alloc_meta_inited=true; }}
-static HMODULE ModuleFromAddr(void* addr){ HMODULE m=nullptr; GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS|GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,(LPCSTR)addr,&m); return m; }
-static HMODULE CallerModule() {
-    void* stack[32]; USHORT skip=2; USHORT depth = (USHORT)min((uint32_t)32, g_cfg.stackTraceDepth ? g_cfg.stackTraceDepth : 12);
-    USHORT n = RtlCaptureStackBackTrace(skip, depth, stack, NULL);
-    for (USHORT i=0;i<n;i++){ HMODULE m=ModuleFromAddr(stack[i]); if (m) return m; }
-    return ModuleFromAddr(_ReturnAddress());
-}
-static void LogMismatch(void* p, const AllocMeta* meta, HMODULE freeMod) {
-    if (!g_cfg.detectCrossModuleMismatch) return;
-    char allocPath[MAX_PATH]={0}, freePath[MAX_PATH]={0};
-    GetModuleFileNameA(meta->mod, allocPath, MAX_PATH); GetModuleFileNameA(freeMod, freePath, MAX_PATH);
-    LOGW("Cross-module free: ptr=%p alloc_mod=%s free_mod=%s size=%zu", p, allocPath, freePath, meta->size);
-}
-
-static void* __cdecl hk_malloc(size_t sz) {
-    if (!g_initialized) return orig_malloc ? orig_malloc(sz) : nullptr;
-    AllocMetaInit();
-    if (g_largeThresholdBytes && sz >= g_largeThresholdBytes) {
-        void* bp = BigAlloc(sz, false);
-        if (bp) return bp;
-    }
-    void* p = rpmalloc(sz);
-    if (p) {
-        if (g_cfg.detectCrossModuleMismatch) {
-            AllocMeta m{}; m.mod = CallerModule(); m.depth = 0; m.size = sz;
-            EnterCriticalSection(&g_alloc_meta_lock); g_alloc_meta[p] = m; LeaveCriticalSection(&g_alloc_meta_lock);
-        }
-        InterlockedIncrement64(&g_allocs); InterlockedExchangeAdd64(&g_bytes_alloc, (LONG64)sz);
+    uint8_t* p = (uint8_t*)HV_AlignUp((uintptr_t)base, alignment);
+    if (!VirtualAlloc(p, size, MEM_COMMIT, PAGE_READWRITE)) {
+        VirtualFree(base, 0, MEM_RELEASE);
+        return nullptr;
     }
+    *offset = (size_t)(p - base);
+    *mapped_size = size + alignment;
     return p;
 }
-static void __cdecl hk_free(void* p) {
-    if (!p) return;
-    if (!g_initialized) { if (orig_free) orig_free(p); return; }
-    // Big block free
-    if (IsBigPtr(p)) {
-        BigFree(p);
-        InterlockedIncrement64(&g_frees);
-        return;
+static void* ArenaSpanMap(size_t size, size_t alignment, size_t* offset, size_t* mapped_size) {
+    *offset = 0;
+    *mapped_size = size;
+    void* p = g_spansInArena ? HighVAAPI::ReserveAligned(size, alignment) : nullptr;
+    if (p && !HighVAAPI::Commit(p, size, PAGE_READWRITE)) {
+        HighVAAPI::Release(p);
+        p = nullptr;
     }
-    size_t s = 0; __try { s = rpmalloc_usable_size(p); } __except(EXCEPTION_EXECUTE_HANDLER) { s = 0; }
-    if (!s) {
-        // Not an rpmalloc pointer; fall back to original to avoid crashes
-        if (g_cfg.detectCrossModuleMismatch) {
-            EnterCriticalSection(&g_alloc_meta_lock);
-            auto it = g_alloc_meta.find(p);
-            HMODULE fm = CallerModule();
-            if (it != g_alloc_meta.end() && it->second.mod != fm) LogMismatch(p, &it->second, fm);
-            if (it != g_alloc_meta.end()) g_alloc_meta.erase(it);
-            LeaveCriticalSection(&g_alloc_meta_lock);
+    if (!p) p = SpanMapSystem(size, alignment, offset, mapped_size);
+    if (p) OwnerRegistry::Mark((uint8_t*)p - *offset, *mapped_size, OwnerRegistry::kRpmalloc);
+    return p;
+}
+static void ArenaSpanCommit(void* address, size_t size) {
+    VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE);
+}
+static void ArenaSpanDecommit(void* address, size_t size) {
+    VirtualFree(address, size, MEM_DECOMMIT);
+}
+static void ArenaSpanUnmap(void* address, size_t offset, size_t mapped_size) {
+    address = (uint8_t*)address - offset;
+    OwnerRegistry::Clear(address, mapped_size);
+    if (HighVAAPI::Contains(address) && HighVAAPI::Release(address)) return;
+    VirtualFree(address, 0, MEM_RELEASE);
+}
+static rpmalloc_interface_t g_spanInterface = { ArenaSpanMap, ArenaSpanCommit, ArenaSpanDecommit, ArenaSpanUnmap, nullptr, nullptr };
+
+// Cross-module mismatch detection (optional, sampled)
+static void LogMismatch(void* p, const MismatchTracker::Record& alloc, HMODULE freeMod) {
+    if (!g_cfg.detectCrossModuleMismatch) return;
+    char allocPath[MAX_PATH]={0}, freePath[MAX_PATH]={0};
+    GetModuleFileNameA(alloc.mod, allocPath, MAX_PATH); GetModuleFileNameA(freeMod, freePath, MAX_PATH);
+    LOGW("Cross-module free: ptr=%p alloc_mod=%s free_mod=%s size=%zu", p, allocPath, freePath, alloc.size);
+}
+static inline void TrackAlloc(void* p, size_t sz, void* caller) {
+    if (MismatchTracker::Sampled(p)) MismatchTracker::OnAlloc(p, sz, caller);
+}
+static inline void TrackFree(void* p, void* caller) {
+    MismatchTracker::Record r; HMODULE fm;
+    if (MismatchTracker::Sampled(p) && MismatchTracker::OnFree(p, caller, &r, &fm)) LogMismatch(p, r, fm);
+}
+
+// CRT hooks, one instantiation per combination of the install-time options so the common configuration
+// (no mismatch tracking, no big routing, no counters) is a straight call into rpmalloc. The variant is
+// chosen once in SelectHookVariants() from the loaded config, options changed by a reload of the INI
+// only take effect on the next start. Hooks are installed after rpmalloc is initialized and never removed,
+// so the variants do not test g_initialized. The entry points pass their return address down as the
+// caller for mismatch tracking, realloc reuses the bodies without becoming the caller itself.
+template <bool Track, bool Big, bool Stats>
+struct CrtHooks {
+    static __forceinline void* AllocFrom(size_t sz, void* caller) {
+        if (Big && sz >= g_largeThresholdBytes) {
+            void* bp = BigBlocks::Alloc(sz, false);
+            if (bp) return bp;
         }
-        if (orig_free) { orig_free(p); return; }
-        return;
+        if (!Track && !Stats) return rpmalloc(sz);
+        void* p = rpmalloc(sz);
+        if (p) {
+            if (Track) TrackAlloc(p, sz, caller);
+            if (Stats) CountAlloc(sz);
+        }
+        return p;
     }
-    if (g_cfg.detectCrossModuleMismatch) {
-        EnterCriticalSection(&g_alloc_meta_lock);
-        auto it = g_alloc_meta.find(p);
-        HMODULE fm = CallerModule();
-        if (it != g_alloc_meta.end() && it->second.mod != fm) LogMismatch(p, &it->second, fm);
-        if (it != g_alloc_meta.end()) g_alloc_meta.erase(it);
-        LeaveCriticalSection(&g_alloc_meta_lock);
-    }
-    rpfree(p);
-    InterlockedIncrement64(&g_frees);
-    if (s) InterlockedExchangeAdd64(&g_bytes_free, (LONG64)s);
-}
-static void* __cdecl hk_calloc(size_t n, size_t sz) {
-    if (!g_initialized) return orig_calloc ? orig_calloc(n, sz) : nullptr;
-    if (!n || !sz || n > SIZE_MAX / sz) return nullptr;
-    AllocMetaInit();
-    SIZE_T req = n * sz;
-    if (g_largeThresholdBytes && req >= g_largeThresholdBytes) {
-        void* bp = BigAlloc(req, true);
-        if (bp) return bp;
-    }
-    void* p = rpcalloc(n, sz);
-    if (p) {
-        if (g_cfg.detectCrossModuleMismatch) {
-            AllocMeta m{}; m.mod = CallerModule(); m.depth = 0; m.size = n*sz;
-            EnterCriticalSection(&g_alloc_meta_lock); g_alloc_meta[p] = m; LeaveCriticalSection(&g_alloc_meta_lock);
+    static __forceinline void FreeFrom(void* p, void* caller) {
+        if (!p) return;
+        if (Big && IsBigPtr(p)) {
+            BigBlocks::Free(p);
+            if (Stats) CountFree(0);
+            return;
+        }
+        if (Track) TrackFree(p, caller);
+        if (!IsRpmallocPtr(p)) {
+            // Not an rpmalloc pointer; fall back to original to avoid crashes
+            if (orig_free) orig_free(p);
+            return;
         }
-        InterlockedIncrement64(&g_allocs); InterlockedExchangeAdd64(&g_bytes_alloc, (LONG64)(n*sz));
+        if (!Stats) { rpfree(p); return; }
+        size_t s = rpmalloc_usable_size(p);
+        rpfree(p);
+        CountFree(s);
     }
-    return p;
-}
-static void* __cdecl hk_realloc(void* p, size_t sz) {
-    if (!g_initialized) return orig_realloc ? orig_realloc(p, sz) : nullptr;
-    if (!p) return hk_malloc(sz);
-    if (!sz) { hk_free(p); return nullptr; }
-
-    // Big block path
-    if (IsBigPtr(p)) {
-        if (g_largeThresholdBytes && sz >= g_largeThresholdBytes) {
-            void* np_big = BigRealloc(p, sz);
-            if (np_big) return np_big;
-        } else {
-            // Move big->small into rpmalloc block
-            void* np_small = rpmalloc(sz);
-            if (np_small) {
-                BigHdr* h = (BigHdr*)((uint8_t*)p - sizeof(BigHdr));
-                SIZE_T copy = (sz < h->size) ? sz : h->size; memcpy(np_small, p, copy);
-                BigFree(p);
-                InterlockedIncrement64(&g_allocs);
-                InterlockedExchangeAdd64(&g_bytes_alloc, (LONG64)sz);
-                return np_small;
-            }
+    static void* __cdecl Malloc(size_t sz) {
+        return AllocFrom(sz, Track ? _ReturnAddress() : nullptr);
+    }
+    static void __cdecl Free(void* p) {
+        FreeFrom(p, Track ? _ReturnAddress() : nullptr);
+    }
+    static void* __cdecl Calloc(size_t n, size_t sz) {
+        if (!n || !sz || n > SIZE_MAX / sz) return nullptr;
+        SIZE_T req = n * sz;
+        if (Big && req >= g_largeThresholdBytes) {
+            void* bp = BigBlocks::Alloc(req, true);
+            if (bp) return bp;
         }
-        return nullptr;
+        if (!Track && !Stats) return rpcalloc(n, sz);
+        void* p = rpcalloc(n, sz);
+        if (p) {
+            if (Track) TrackAlloc(p, req, _ReturnAddress());
+            if (Stats) CountAlloc(req);
+        }
+        return p;
     }
+    static void* __cdecl Realloc(void* p, size_t sz) {
+        void* caller = Track ? _ReturnAddress() : nullptr;
+        if (!p) return AllocFrom(sz, caller);
+        if (!sz) { FreeFrom(p, caller); return nullptr; }
+
+        // Big block path
+        if (Big && IsBigPtr(p)) {
+            if (sz >= g_largeThresholdBytes) {
+                void* np_big = BigBlocks::Realloc(p, sz);
+                if (np_big) return np_big;
+            } else {
+                // Move big->small into rpmalloc block
+                void* np_small = rpmalloc(sz);
+                if (np_small) {
+                    SIZE_T old = BigBlocks::Size(p);
+                    memcpy(np_small, p, (sz < old) ? sz : old);
+                    BigBlocks::Free(p);
+                    if (Track) TrackAlloc(np_small, sz, caller);
+                    if (Stats) CountAlloc(sz);
+                    return np_small;
+                }
+            }
+            return nullptr;
+        }
 
-    size_t old = 0; __try { old = rpmalloc_usable_size(p); } __except(EXCEPTION_EXECUTE_HANDLER) { old = 0; }
-    if (g_largeThresholdBytes && sz >= g_largeThresholdBytes) {
-        // small->big: allocate big, copy, free small
-        void* np_big = BigAlloc(sz, false);
-        if (np_big) {
-            SIZE_T copy = (sz < old) ? sz : old; if (copy) memcpy(np_big, p, copy);
-            rpfree(p);
-            InterlockedIncrement64(&g_frees); if (old) InterlockedExchangeAdd64(&g_bytes_free, (LONG64)old);
-            InterlockedIncrement64(&g_allocs); InterlockedExchangeAdd64(&g_bytes_alloc, (LONG64)sz);
-            return np_big;
+        if (!IsRpmallocPtr(p)) return orig_realloc ? orig_realloc(p, sz) : nullptr;
+        size_t old = (Big || Stats) ? rpmalloc_usable_size(p) : 0;
+        if (Big && sz >= g_largeThresholdBytes) {
+            // small->big: allocate big, copy, free small
+            void* np_big = BigBlocks::Alloc(sz, false);
+            if (np_big) {
+                SIZE_T copy = (sz < old) ? sz : old; if (copy) memcpy(np_big, p, copy);
+                if (Track) TrackFree(p, caller);
+                rpfree(p);
+                if (Stats) { CountFree(old); CountAlloc(sz); }
+                return np_big;
+            }
+            // fallthrough to rprealloc if the big block allocation failed
         }
-        // fallthrough to rprealloc if BigAlloc failed
+        if (!Track && !Stats) return rprealloc(p, sz);
+        void* np = rprealloc(p, sz);
+        if (np) {
+            if (Track) { TrackFree(p, caller); TrackAlloc(np, sz, caller); }
+            if (Stats) { CountFree(old); CountAlloc(sz); }
+        }
+        return np;
+    }
+};
+
+// Virtualized Win32 heaps. HeapCreate still creates the system heap, so the handle stays valid for code
+// that is not hooked and keeps the blocks above the routing threshold, and maps the handle to an
+// OverdriveHeap for the routed blocks. HeapDestroy then drops all of them at once. Executable and
+// fixed-size heaps are mapped as pass-through and stay entirely on the system heap. Handles not created
+// through the hook (process heap, CRT heap) keep routing to the calling thread's rpmalloc heap.
+// Open addressing by handle, looked up without a lock, written under g_heapMapLock.
+struct HeapEntry { HANDLE volatile handle; OverdriveHeap::Heap* heap; bool passthrough; };
+static const unsigned kHeapSlots = 512, kHeapProbe = 32;
+static const HANDLE kHeapDeleted = (HANDLE)1;
+static HeapEntry g_heapMap[kHeapSlots];
+static SRWLOCK g_heapMapLock = SRWLOCK_INIT;
+static inline unsigned HeapSlot(HANDLE h) { return (unsigned)(((uintptr_t)h >> 16) * 0x9E3779B1u >> 23); }
+static inline HeapEntry* FindHeap(HANDLE h) {
+    unsigned idx = HeapSlot(h);
+    for (unsigned i = 0; i < kHeapProbe; ++i) {
+        HeapEntry* e = &g_heapMap[(idx + i) % kHeapSlots];
+        HANDLE k = e->handle;
+        if (k == h) return e;
+        if (!k) return nullptr;
+    }
+    return nullptr;
+}
+static bool RegisterHeap(HANDLE h, OverdriveHeap::Heap* heap, bool passthrough) {
+    AcquireSRWLockExclusive(&g_heapMapLock);
+    unsigned idx = HeapSlot(h);
+    HeapEntry* slot = nullptr;
+    for (unsigned i = 0; i < kHeapProbe && !slot; ++i) {
+        HeapEntry* e = &g_heapMap[(idx + i) % kHeapSlots];
+        if (!e->handle || e->handle == kHeapDeleted) slot = e;
+    }
+    if (slot) {
+        slot->heap = heap; slot->passthrough = passthrough;
+        InterlockedExchangePointer((PVOID volatile*)&slot->handle, h);
     }
-    void* np = rprealloc(p, sz);
-    if (np) {
-        if (g_cfg.detectCrossModuleMismatch) {
-            AllocMeta m{}; m.mod = CallerModule(); m.depth = 0; m.size = sz;
-            EnterCriticalSection(&g_alloc_meta_lock); g_alloc_meta[np] = m; g_alloc_meta.erase(p); LeaveCriticalSection(&g_alloc_meta_lock);
+    ReleaseSRWLockExclusive(&g_heapMapLock);
+    return slot != nullptr;
+}
+static OverdriveHeap::Heap* UnregisterHeap(HANDLE h) {
+    AcquireSRWLockExclusive(&g_heapMapLock);
+    HeapEntry* e = FindHeap(h);
+    OverdriveHeap::Heap* heap = e ? e->heap : nullptr;
+    if (e) InterlockedExchangePointer((PVOID volatile*)&e->handle, kHeapDeleted);
+    ReleaseSRWLockExclusive(&g_heapMapLock);
+    return heap;
+}
+
+// Win32 Heap hooks (route small/medium to rpmalloc), specialized on the counters only. bHookHeapAPI stays
+// a runtime test so a reload can still route heap calls back to the system heap. A routed allocation that
+// fails falls back to the system heap, which raises the exception for HEAP_GENERATE_EXCEPTIONS.
+template <bool Stats>
+struct HeapHooks {
+    static LPVOID WINAPI Alloc(HANDLE hHeap, DWORD dwFlags, SIZE_T dwBytes) {
+        if (!g_cfg.hookHeapAPI) return orig_HeapAlloc ? orig_HeapAlloc(hHeap, dwFlags, dwBytes) : nullptr;
+        SIZE_T thr = (SIZE_T)g_cfg.heapHookThresholdKB * 1024ULL;
+        if (dwBytes && dwBytes <= thr) {
+            HeapEntry* e = FindHeap(hHeap);
+            bool zero = (dwFlags & HEAP_ZERO_MEMORY) != 0;
+            void* p = nullptr;
+            if (!e) p = zero ? rpcalloc(1, dwBytes) : rpmalloc(dwBytes);
+            else if (!e->passthrough) p = OverdriveHeap::Alloc(e->heap, dwBytes, zero);
+            if (p) {
+                if (Stats) CountAlloc(dwBytes);
+                return p;
+            }
         }
-        InterlockedIncrement64(&g_frees);
-        if (old) InterlockedExchangeAdd64(&g_bytes_free, (LONG64)old);
-        InterlockedIncrement64(&g_allocs);
-        InterlockedExchangeAdd64(&g_bytes_alloc, (LONG64)sz);
-    }
-    return np;
-}
-
-// Win32 Heap hooks (route small/medium to rpmalloc)
-static LPVOID WINAPI hk_HeapAlloc(HANDLE hHeap, DWORD dwFlags, SIZE_T dwBytes) {
-    if (!g_initialized || !g_cfg.hookHeapAPI) return orig_HeapAlloc ? orig_HeapAlloc(hHeap, dwFlags, dwBytes) : nullptr;
-    SIZE_T thr = (SIZE_T)g_cfg.heapHookThresholdKB * 1024ULL;
-    if (dwBytes && dwBytes <= thr) {
-        void* p = rpmalloc(dwBytes);
-        if (p && (dwFlags & HEAP_ZERO_MEMORY)) memset(p, 0, dwBytes);
-        if (p) { InterlockedIncrement64(&g_allocs); InterlockedExchangeAdd64(&g_bytes_alloc, (LONG64)dwBytes); }
-        return p;
+        return orig_HeapAlloc ? orig_HeapAlloc(hHeap, dwFlags, dwBytes) : nullptr;
     }
-    return orig_HeapAlloc ? orig_HeapAlloc(hHeap, dwFlags, dwBytes) : nullptr;
-}
-static BOOL WINAPI hk_HeapFree(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem);
-static LPVOID WINAPI hk_HeapReAlloc(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem, SIZE_T dwBytes) {
-    if (!g_initialized || !g_cfg.hookHeapAPI) return orig_HeapReAlloc ? orig_HeapReAlloc(hHeap, dwFlags, lpMem, dwBytes) : nullptr;
-    SIZE_T thr = (SIZE_T)g_cfg.heapHookThresholdKB * 1024ULL;
-    if (!lpMem) return hk_HeapAlloc(hHeap, dwFlags, dwBytes);
-    if (dwBytes == 0) { hk_HeapFree(hHeap, 0, lpMem); return nullptr; }
-    if (dwBytes <= thr) {
-        size_t old = 0; __try { old = rpmalloc_usable_size(lpMem); } __except(EXCEPTION_EXECUTE_HANDLER) { old = 0; }
-        void* np = rprealloc(lpMem, dwBytes);
+    static LPVOID WINAPI ReAlloc(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem, SIZE_T dwBytes) {
+        if (!g_cfg.hookHeapAPI) return orig_HeapReAlloc ? orig_HeapReAlloc(hHeap, dwFlags, lpMem, dwBytes) : nullptr;
+        SIZE_T thr = (SIZE_T)g_cfg.heapHookThresholdKB * 1024ULL;
+        if (!lpMem) return Alloc(hHeap, dwFlags, dwBytes);
+        if (dwBytes == 0) { Free(hHeap, 0, lpMem); return nullptr; }
+        if (!IsRpmallocPtr(lpMem)) return orig_HeapReAlloc ? orig_HeapReAlloc(hHeap, dwFlags, lpMem, dwBytes) : nullptr;
+        size_t old = rpmalloc_usable_size(lpMem);
+        bool inPlace = (dwFlags & HEAP_REALLOC_IN_PLACE_ONLY) != 0;
+        HeapEntry* e = FindHeap(hHeap);
+        OverdriveHeap::Heap* heap = (e && !e->passthrough) ? e->heap : nullptr;
+        void* np = nullptr;
+        if (dwBytes <= thr || inPlace) {
+            unsigned rf = inPlace ? RPMALLOC_GROW_OR_FAIL : 0;
+            np = heap ? OverdriveHeap::Realloc(heap, lpMem, dwBytes, rf) : rpaligned_realloc(lpMem, 0, dwBytes, 0, rf);
+        } else if (orig_HeapAlloc) {
+            // Grown past the routing threshold, move the block to the system heap
+            np = orig_HeapAlloc(hHeap, dwFlags & ~HEAP_ZERO_MEMORY, dwBytes);
+            if (np) {
+                memcpy(np, lpMem, old);
+                if (heap) OverdriveHeap::Free(heap, lpMem); else rpfree(lpMem);
+                if (Stats) CountFree(old);
+                if (dwFlags & HEAP_ZERO_MEMORY) memset((char*)np + old, 0, dwBytes - old);
+                return np;
+            }
+        }
         if (np) {
             if (dwFlags & HEAP_ZERO_MEMORY) { if (dwBytes > old) memset((char*)np + old, 0, dwBytes - old); }
-            if (old) InterlockedExchangeAdd64(&g_bytes_free, (LONG64)old);
-            InterlockedIncrement64(&g_frees);
-            InterlockedIncrement64(&g_allocs);
-            InterlockedExchangeAdd64(&g_bytes_alloc, (LONG64)dwBytes);
+            if (Stats) { CountFree(old); CountAlloc(dwBytes); }
         }
         return np;
     }
-    return orig_HeapReAlloc ? orig_HeapReAlloc(hHeap, dwFlags, lpMem, dwBytes) : nullptr;
-}
-static BOOL WINAPI hk_HeapFree(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem) {
-    if (!lpMem) return TRUE;
-    if (!g_initialized || !g_cfg.hookHeapAPI) return orig_HeapFree ? orig_HeapFree(hHeap, dwFlags, lpMem) : FALSE;
-    size_t sz = 0; __try { sz = rpmalloc_usable_size(lpMem); } __except(EXCEPTION_EXECUTE_HANDLER) { sz = 0; }
-    if (sz) {
-        rpfree(lpMem);
-        InterlockedIncrement64(&g_frees);
-        InterlockedExchangeAdd64(&g_bytes_free, (LONG64)sz);
-        return TRUE;
+    static BOOL WINAPI Free(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem) {
+        if (!lpMem) return TRUE;
+        if (!g_cfg.hookHeapAPI) return orig_HeapFree ? orig_HeapFree(hHeap, dwFlags, lpMem) : FALSE;
+        if (IsRpmallocPtr(lpMem)) {
+            size_t sz = Stats ? rpmalloc_usable_size(lpMem) : 0;
+            HeapEntry* e = FindHeap(hHeap);
+            if (e && !e->passthrough) OverdriveHeap::Free(e->heap, lpMem); else rpfree(lpMem);
+            if (Stats) CountFree(sz);
+            return TRUE;
+        }
+        return orig_HeapFree ? orig_HeapFree(hHeap, dwFlags, lpMem) : FALSE;
     }
-    return orig_HeapFree ? orig_HeapFree(hHeap, dwFlags, lpMem) : FALSE;
+};
+
+static HANDLE WINAPI hk_HeapCreate(DWORD flOptions, SIZE_T dwInitialSize, SIZE_T dwMaximumSize) {
+    HANDLE h = orig_HeapCreate ? orig_HeapCreate(flOptions, dwInitialSize, dwMaximumSize) : nullptr;
+    if (!h || !g_cfg.hookHeapAPI) return h;
+    if ((flOptions & HEAP_CREATE_ENABLE_EXECUTE) || dwMaximumSize) {
+        RegisterHeap(h, nullptr, true);
+        return h;
+    }
+    OverdriveHeap::Heap* heap = OverdriveHeap::Create();
+    if (heap && !RegisterHeap(h, heap, false)) { OverdriveHeap::Destroy(heap); heap = nullptr; }
+    if (!heap) LOGW("HeapCreate: heap %p not virtualized, routed blocks go to the thread heap", h);
+    return h;
+}
+static BOOL WINAPI hk_HeapDestroy(HANDLE hHeap) {
+    if (OverdriveHeap::Heap* heap = UnregisterHeap(hHeap)) OverdriveHeap::Destroy(heap);
+    return orig_HeapDestroy ? orig_HeapDestroy(hHeap) : FALSE;
+}
+// Usable size for rpmalloc blocks, which can exceed the requested size
+static SIZE_T WINAPI hk_HeapSize(HANDLE hHeap, DWORD dwFlags, LPCVOID lpMem) {
+    if (lpMem && IsRpmallocPtr((void*)lpMem)) return rpmalloc_usable_size((void*)lpMem);
+    return orig_HeapSize ? orig_HeapSize(hHeap, dwFlags, lpMem) : (SIZE_T)-1;
+}
+static BOOL WINAPI hk_HeapValidate(HANDLE hHeap, DWORD dwFlags, LPCVOID lpMem) {
+    if (lpMem && IsRpmallocPtr((void*)lpMem)) return TRUE;
+    return orig_HeapValidate ? orig_HeapValidate(hHeap, dwFlags, lpMem) : FALSE;
+}
+// Compacts both halves of a virtualized heap, the result is the largest free block of the system half
+static SIZE_T WINAPI hk_HeapCompact(HANDLE hHeap, DWORD dwFlags) {
+    HeapEntry* e = FindHeap(hHeap);
+    if (e && !e->passthrough) OverdriveHeap::Compact(e->heap);
+    return orig_HeapCompact ? orig_HeapCompact(hHeap, dwFlags) : 0;
+}
+// rpmalloc cannot enumerate blocks, a walk of a virtualized heap fails rather than skip the routed blocks
+static BOOL WINAPI hk_HeapWalk(HANDLE hHeap, LPPROCESS_HEAP_ENTRY lpEntry) {
+    HeapEntry* e = FindHeap(hHeap);
+    if (e && !e->passthrough) { SetLastError(ERROR_NOT_SUPPORTED); return FALSE; }
+    return orig_HeapWalk ? orig_HeapWalk(hHeap, lpEntry) : FALSE;
+}
+
+// Hook variant table, indexed by (track << 2) | (big << 1) | stats
+struct HookSet {
+    void* malloc_; void* free_; void* calloc_; void* realloc_;
+    void* heapAlloc; void* heapReAlloc; void* heapFree;
+};
+template <bool Track, bool Big, bool Stats>
+static HookSet MakeHookSet() {
+    typedef CrtHooks<Track, Big, Stats> C; typedef HeapHooks<Stats> H;
+    return { (void*)&C::Malloc, (void*)&C::Free, (void*)&C::Calloc, (void*)&C::Realloc,
+             (void*)&H::Alloc, (void*)&H::ReAlloc, (void*)&H::Free };
+}
+static const HookSet g_hookVariants[8] = {
+    MakeHookSet<false, false, false>(), MakeHookSet<false, false, true>(),
+    MakeHookSet<false, true,  false>(), MakeHookSet<false, true,  true>(),
+    MakeHookSet<true,  false, false>(), MakeHookSet<true,  false, true>(),
+    MakeHookSet<true,  true,  false>(), MakeHookSet<true,  true,  true>(),
+};
+static HookSet g_hooks = g_hookVariants[0];
+static void SelectHookVariants() {
+    bool track = g_cfg.detectCrossModuleMismatch, big = g_largeThresholdBytes != 0, stats = g_cfg.countAllocations;
+    if (stats) CounterShardsInit();
+    if (track && !MismatchTracker::Init(g_cfg.mismatchSampleRate)) { LOGW("Mismatch tracker table unavailable, tracking off"); track = false; }
+    g_hooks = g_hookVariants[(track ? 4 : 0) | (big ? 2 : 0) | (stats ? 1 : 0)];
+    LOGI("Allocator hooks: mismatch tracking=%d (1 in %u) big routing=%d counters=%d", track ? 1 : 0,
+         track ? MismatchTracker::g_sampleMask + 1 : 0, big ? 1 : 0, stats ? 1 : 0);
 }
 
 // VirtualAlloc hook with arena steering and top-down fallback
@@ -554,38 +765,58 @@ static void InstallHooksAcrossModules() {
     size_t cnt = needed/sizeof(HMODULE);
     for (size_t i=0;i<cnt;i++) {
         HMODULE m=mods[i]; if (!IsWhitelisted(m)) continue;
-        HookIATEntryInModuleEx(m, "msvcrt.dll",   "malloc",  (void*)hk_malloc,  nullptr, g_cfg.hookChainExisting);
-        HookIATEntryInModuleEx(m, "msvcrt.dll",   "free",    (void*)hk_free,    nullptr, g_cfg.hookChainExisting);
-        HookIATEntryInModuleEx(m, "msvcrt.dll",   "calloc",  (void*)hk_calloc,  nullptr, g_cfg.hookChainExisting);
-        HookIATEntryInModuleEx(m, "msvcrt.dll",   "realloc", (void*)hk_realloc, nullptr, g_cfg.hookChainExisting);
-        HookIATEntryInModuleEx(m, "ucrtbase.dll", "malloc",  (void*)hk_malloc,  nullptr, g_cfg.hookChainExisting);
-        HookIATEntryInModuleEx(m, "ucrtbase.dll", "free",    (void*)hk_free,    nullptr, g_cfg.hookChainExisting);
-        HookIATEntryInModuleEx(m, "ucrtbase.dll", "calloc",  (void*)hk_calloc,  nullptr, g_cfg.hookChainExisting);
-        HookIATEntryInModuleEx(m, "ucrtbase.dll", "realloc", (void*)hk_realloc, nullptr, g_cfg.hookChainExisting);
+        HookIATEntryInModuleEx(m, "msvcrt.dll",   "malloc",  g_hooks.malloc_,  nullptr, g_cfg.hookChainExisting);
+        HookIATEntryInModuleEx(m, "msvcrt.dll",   "free",    g_hooks.free_,    nullptr, g_cfg.hookChainExisting);
+        HookIATEntryInModuleEx(m, "msvcrt.dll",   "calloc",  g_hooks.calloc_,  nullptr, g_cfg.hookChainExisting);
+        HookIATEntryInModuleEx(m, "msvcrt.dll",   "realloc", g_hooks.realloc_, nullptr, g_cfg.hookChainExisting);
+        HookIATEntryInModuleEx(m, "ucrtbase.dll", "malloc",  g_hooks.malloc_,  nullptr, g_cfg.hookChainExisting);
+        HookIATEntryInModuleEx(m, "ucrtbase.dll", "free",    g_hooks.free_,    nullptr, g_cfg.hookChainExisting);
+        HookIATEntryInModuleEx(m, "ucrtbase.dll", "calloc",  g_hooks.calloc_,  nullptr, g_cfg.hookChainExisting);
+        HookIATEntryInModuleEx(m, "ucrtbase.dll", "realloc", g_hooks.realloc_, nullptr, g_cfg.hookChainExisting);
         if (g_cfg.hookHeapAPI) {
-            HookIATEntryInModuleEx(m, "kernel32.dll", "HeapAlloc",   (void*)hk_HeapAlloc,   nullptr, g_cfg.hookChainExisting);
-            HookIATEntryInModuleEx(m, "kernel32.dll", "HeapReAlloc", (void*)hk_HeapReAlloc, nullptr, g_cfg.hookChainExisting);
-            HookIATEntryInModuleEx(m, "kernel32.dll", "HeapFree",    (void*)hk_HeapFree,    nullptr, g_cfg.hookChainExisting);
+            HookIATEntryInModuleEx(m, "kernel32.dll", "HeapAlloc",   g_hooks.heapAlloc,   nullptr, g_cfg.hookChainExisting);
+            HookIATEntryInModuleEx(m, "kernel32.dll", "HeapReAlloc", g_hooks.heapReAlloc, nullptr, g_cfg.hookChainExisting);
+            HookIATEntryInModuleEx(m, "kernel32.dll", "HeapFree",    g_hooks.heapFree,    nullptr, g_cfg.hookChainExisting);
+            HookIATEntryInModuleEx(m, "kernel32.dll", "HeapCreate",   (void*)hk_HeapCreate,   nullptr, g_cfg.hookChainExisting);
+            HookIATEntryInModuleEx(m, "kernel32.dll", "HeapDestroy",  (void*)hk_HeapDestroy,  nullptr, g_cfg.hookChainExisting);
+            HookIATEntryInModuleEx(m, "kernel32.dll", "HeapSize",     (void*)hk_HeapSize,     nullptr, g_cfg.hookChainExisting);
+            HookIATEntryInModuleEx(m, "kernel32.dll", "HeapValidate", (void*)hk_HeapValidate, nullptr, g_cfg.hookChainExisting);
+            HookIATEntryInModuleEx(m, "kernel32.dll", "HeapCompact",  (void*)hk_HeapCompact,  nullptr, g_cfg.hookChainExisting);
+            HookIATEntryInModuleEx(m, "kernel32.dll", "HeapWalk",     (void*)hk_HeapWalk,     nullptr, g_cfg.hookChainExisting);
         }
         if (g_cfg.hookVirtualAlloc) {
             HookIATEntryInModuleEx(m, "kernel32.dll", "VirtualAlloc", (void*)hk_VirtualAlloc, nullptr, g_cfg.hookChainExisting);
         }
     }
 }
+template <typename F> static void ResolveOrig(F& fn, const char* name) {
+    if (!fn) fn = (F)GetProcAddress(GetModuleHandleA("kernel32.dll"), name);
+}
 static bool InstallAllocatorHooks() {
     bool ok=false;
-    ok |= HookIATEntry("msvcrt.dll",   "malloc",  (void*)hk_malloc,  (void**)&orig_malloc);
-    ok |= HookIATEntry("msvcrt.dll",   "free",    (void*)hk_free,    (void**)&orig_free);
-    ok |= HookIATEntry("msvcrt.dll",   "calloc",  (void*)hk_calloc,  (void**)&orig_calloc);
-    ok |= HookIATEntry("msvcrt.dll",   "realloc", (void*)hk_realloc, (void**)&orig_realloc);
-    ok |= HookIATEntry("ucrtbase.dll", "malloc",  (void*)hk_malloc,  nullptr);
-    ok |= HookIATEntry("ucrtbase.dll", "free",    (void*)hk_free,    nullptr);
-    ok |= HookIATEntry("ucrtbase.dll", "calloc",  (void*)hk_calloc,  nullptr);
-    ok |= HookIATEntry("ucrtbase.dll", "realloc", (void*)hk_realloc, nullptr);
+    ok |= HookIATEntry("msvcrt.dll",   "malloc",  g_hooks.malloc_,  (void**)&orig_malloc);
+    ok |= HookIATEntry("msvcrt.dll",   "free",    g_hooks.free_,    (void**)&orig_free);
+    ok |= HookIATEntry("msvcrt.dll",   "calloc",  g_hooks.calloc_,  (void**)&orig_calloc);
+    ok |= HookIATEntry("msvcrt.dll",   "realloc", g_hooks.realloc_, (void**)&orig_realloc);
+    ok |= HookIATEntry("ucrtbase.dll", "malloc",  g_hooks.malloc_,  nullptr);
+    ok |= HookIATEntry("ucrtbase.dll", "free",    g_hooks.free_,    nullptr);
+    ok |= HookIATEntry("ucrtbase.dll", "calloc",  g_hooks.calloc_,  nullptr);
+    ok |= HookIATEntry("ucrtbase.dll", "realloc", g_hooks.realloc_, nullptr);
     if (g_cfg.hookHeapAPI) {
-        ok |= HookIATEntry("kernel32.dll", "HeapAlloc",   (void*)hk_HeapAlloc,   (void**)&orig_HeapAlloc);
-        ok |= HookIATEntry("kernel32.dll", "HeapReAlloc", (void*)hk_HeapReAlloc, (void**)&orig_HeapReAlloc);
-        ok |= HookIATEntry("kernel32.dll", "HeapFree",    (void*)hk_HeapFree,    (void**)&orig_HeapFree);
+        ok |= HookIATEntry("kernel32.dll", "HeapAlloc",   g_hooks.heapAlloc,   (void**)&orig_HeapAlloc);
+        ok |= HookIATEntry("kernel32.dll", "HeapReAlloc", g_hooks.heapReAlloc, (void**)&orig_HeapReAlloc);
+        ok |= HookIATEntry("kernel32.dll", "HeapFree",    g_hooks.heapFree,    (void**)&orig_HeapFree);
+        ok |= HookIATEntry("kernel32.dll", "HeapCreate",   (void*)hk_HeapCreate,   (void**)&orig_HeapCreate);
+        ok |= HookIATEntry("kernel32.dll", "HeapDestroy",  (void*)hk_HeapDestroy,  (void**)&orig_HeapDestroy);
+        ok |= HookIATEntry("kernel32.dll", "HeapSize",     (void*)hk_HeapSize,     (void**)&orig_HeapSize);
+        ok |= HookIATEntry("kernel32.dll", "HeapValidate", (void*)hk_HeapValidate, (void**)&orig_HeapValidate);
+        ok |= HookIATEntry("kernel32.dll", "HeapCompact",  (void*)hk_HeapCompact,  (void**)&orig_HeapCompact);
+        ok |= HookIATEntry("kernel32.dll", "HeapWalk",     (void*)hk_HeapWalk,     (void**)&orig_HeapWalk);
+        // Other modules may import heap functions the exe does not, chain those to the kernel32 export
+        ResolveOrig(orig_HeapAlloc, "HeapAlloc"); ResolveOrig(orig_HeapReAlloc, "HeapReAlloc"); ResolveOrig(orig_HeapFree, "HeapFree");
+        ResolveOrig(orig_HeapCreate, "HeapCreate"); ResolveOrig(orig_HeapDestroy, "HeapDestroy");
+        ResolveOrig(orig_HeapSize, "HeapSize"); ResolveOrig(orig_HeapValidate, "HeapValidate");
+        ResolveOrig(orig_HeapCompact, "HeapCompact"); ResolveOrig(orig_HeapWalk, "HeapWalk");
     }
     if (g_cfg.hookVirtualAlloc) {
         ok |= HookIATEntry("kernel32.dll", "VirtualAlloc", (void*)hk_VirtualAlloc, (void**)&orig_VirtualAlloc);
@@ -679,6 +910,71 @@ static void AdjustBudgetsDynamically(double ema_ms) {
     }
 }
 
+// Allocator memory pressure: step up as free VA or commit headroom drops below the threshold, half and a quarter
+static unsigned int PressureLevel(DWORDLONG avail, uint32_t thresholdMB) {
+    if (!thresholdMB) return RPMALLOC_MEMORY_PRESSURE_NONE;
+    DWORDLONG t = (DWORDLONG)thresholdMB * 1024ull * 1024ull;
+    if (avail < t / 4) return RPMALLOC_MEMORY_PRESSURE_CRITICAL;
+    if (avail < t / 2) return RPMALLOC_MEMORY_PRESSURE_HIGH;
+    if (avail < t) return RPMALLOC_MEMORY_PRESSURE_MODERATE;
+    return RPMALLOC_MEMORY_PRESSURE_NONE;
+}
+static void UpdateAllocatorPressure() {
+    MEMORYSTATUSEX ms{}; ms.dwLength = sizeof(ms);
+    if (!GlobalMemoryStatusEx(&ms)) return;
+    unsigned int level = PressureLevel(ms.ullAvailVirtual, g_cfg.pressureVAMB);
+    unsigned int commit = PressureLevel(ms.ullAvailPageFile, g_cfg.pressureCommitMB);
+    if (commit > level) level = commit;
+    // Enough free VA in total but no large region left at the top is as bad as running out
+    if (g_cfg.pressureVAMB && level < RPMALLOC_MEMORY_PRESSURE_HIGH && LowVAAvailable()) level = RPMALLOC_MEMORY_PRESSURE_HIGH;
+    unsigned int prev = rpmalloc_memory_pressure();
+    if (level == prev) return;
+    rpmalloc_set_memory_pressure(level);
+    LOGI("Allocator pressure %u -> %u (VA free=%lluMB commit free=%lluMB)", prev, level,
+         (unsigned long long)(ms.ullAvailVirtual >> 20), (unsigned long long)(ms.ullAvailPageFile >> 20));
+}
+
+// Background scavenger: decommits idle free pages so game threads never issue the decommit calls, and
+// takes the free pages of idle threads (loader threads after fast travel) once a second. The thread holds
+// a reference to this module so FreeLibrary cannot unmap it while it runs, it drops the reference when it
+// exits. g_scavengerBusy is set while it is inside rpmalloc, a thread terminated at process exit with it
+// set may hold rpmalloc locks.
+static const DWORD kScavengeIntervalMs = 250;
+static HANDLE g_scavengerThread = nullptr;
+static HANDLE g_scavengerStop = nullptr;
+static volatile LONG g_scavengerBusy = 0;
+static DWORD WINAPI ScavengerThread(LPVOID self) {
+    size_t budget = (size_t)g_cfg.scavengeMBPerSec * 1024 * 1024 / (1000 / kScavengeIntervalMs);
+    for (uint32_t tick = 1; WaitForSingleObject(g_scavengerStop, kScavengeIntervalMs) == WAIT_TIMEOUT; ++tick) {
+        InterlockedExchange(&g_scavengerBusy, 1);
+        if (g_cfg.threadIdleTrimSec && !(tick % (1000 / kScavengeIntervalMs))) {
+            size_t trimmed = rpmalloc_trim_idle_heaps(g_cfg.threadIdleTrimSec * 1000);
+            if (trimmed) LOG_DEBUG("rpmalloc idle trim: %zu KB", trimmed >> 10);
+        }
+        if (budget) rpmalloc_scavenge(budget, g_cfg.scavengeAgeMs);
+        InterlockedExchange(&g_scavengerBusy, 0);
+    }
+    rpmalloc_thread_finalize();
+    FreeLibraryAndExitThread((HMODULE)self, 0);
+}
+static void StartScavenger() {
+    HMODULE self = nullptr;
+    g_scavengerStop = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    if (!g_scavengerStop || !GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, (LPCSTR)&ScavengerThread, &self)) return;
+    g_scavengerThread = CreateThread(nullptr, 64 * 1024, ScavengerThread, self, 0, nullptr);
+    if (g_scavengerThread) SetThreadPriority(g_scavengerThread, THREAD_PRIORITY_LOWEST);
+    else FreeLibrary(self);
+}
+// Signal the scavenger and join it. Returns false if it was terminated inside rpmalloc (process exit)
+static bool StopScavenger() {
+    if (!g_scavengerThread) return true;
+    SetEvent(g_scavengerStop);
+    WaitForSingleObject(g_scavengerThread, INFINITE);
+    CloseHandle(g_scavengerThread);
+    g_scavengerThread = nullptr;
+    return !g_scavengerBusy;
+}
+
 // Telemetry
 static void WriteTelemetryIfDue() {
     if (!g_cfg.telemetryEnabled) return;
@@ -686,17 +982,20 @@ static void WriteTelemetryIfDue() {
     uint32_t period = g_cfg.telemetryPeriodFrames ? g_cfg.telemetryPeriodFrames : 300;
     if ((uint32_t)f % period != 0) return;
     VirtualFreeStats vfs{}; GetVirtualFreeStats(&vfs);
+    rpmalloc_global_statistics_t rps; rpmalloc_global_statistics(&rps); // zero unless built with ENABLE_STATISTICS=1
+    CounterTotals ct = ReadCounters();
     HANDLE h = CreateFileA(g_cfg.telemetryFile, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
     if (h != INVALID_HANDLE_VALUE) {
         DWORD written=0; SetFilePointer(h, 0, NULL, FILE_END);
         if (GetFileSize(h, NULL) == 0) {
-            const char* header = "allocs,frees,bytes_alloc,bytes_free,vfree_calls,decommit_blocked,decommit_delayed,bytes_kept\r\n";
+            const char* header = "allocs,frees,bytes_alloc,bytes_free,vfree_calls,decommit_blocked,decommit_delayed,bytes_kept,rp_mapped,rp_mapped_peak,rp_huge\r\n";
             WriteFile(h, header, (DWORD)strlen(header), &written, NULL);
         }
         char line[512];
-        _snprintf_s(line, _TRUNCATE, "%lld,%lld,%lld,%lld,%ld,%ld,%ld,%zu\r\n",
-                    (long long)g_allocs, (long long)g_frees, (long long)g_bytes_alloc, (long long)g_bytes_free,
-                    vfs.total_calls, vfs.decommit_blocked, vfs.decommit_delayed, vfs.bytes_kept_committed);
+        _snprintf_s(line, _TRUNCATE, "%lld,%lld,%lld,%lld,%ld,%ld,%ld,%zu,%zu,%zu,%zu\r\n",
+                    (long long)ct.allocs, (long long)ct.frees, (long long)ct.bytes_alloc, (long long)ct.bytes_free,
+                    vfs.total_calls, vfs.decommit_blocked, vfs.decommit_delayed, vfs.bytes_kept_committed,
+                    rps.mapped, rps.mapped_peak, rps.huge_alloc);
         WriteFile(h, line, (DWORD)strlen(line), &written, NULL);
         CloseHandle(h);
     }
@@ -715,14 +1014,7 @@ static void MessageHandler(NVSEMessagingInterface::Message* msg) {
             QueryPerformanceFrequency(&g_qpf);
             QueryPerformanceCounter(&g_last_tick);
             g_ema_ms = g_cfg.targetMsPerFrame;
-            // rpmalloc
-            // rpmalloc (tuned); disable decommit handled by compile flags; keep default page size
-            rpmalloc_config_t rcfg{}; memset(&rcfg, 0, sizeof(rcfg));
-            rcfg.enable_huge_pages = 0; rcfg.disable_decommit = 1; rcfg.unmap_on_finalize = 0; rcfg.page_name = "Overdrive";
-            rpmalloc_initialize_config(nullptr, &rcfg);
-            g_largeThresholdBytes = (SIZE_T)g_cfg.largeAllocThresholdMB * 1024ull * 1024ull;
-
-            // High VA arena init
+            // High VA arena init (before rpmalloc, which maps its spans from the arena)
             HighVAOptions hv{};
             hv.enable_arena = g_cfg.enableArena;
             hv.arena_size_bytes = (size_t)g_cfg.arenaMB * 1024ull * 1024ull;
@@ -737,6 +1029,29 @@ static void MessageHandler(NVSEMessagingInterface::Message* msg) {
                 LOGW("Arena not active (reserve failed or disabled)");
             }
 
+            // rpmalloc (tuned); disable decommit handled by compile flags; keep default page size
+            rpmalloc_config_t rcfg{}; memset(&rcfg, 0, sizeof(rcfg));
+            rcfg.enable_huge_pages = 0; rcfg.disable_decommit = 1; rcfg.unmap_on_finalize = 0; rcfg.page_name = "Overdrive";
+            rcfg.span_geometry = (int)g_cfg.spanGeometry;
+            rcfg.huge_cache_size = (size_t)g_cfg.hugeCacheMB * 1024 * 1024; rcfg.disable_huge_cache = g_cfg.hugeCacheMB ? 0 : 1;
+            rcfg.enable_scavenger = g_cfg.scavengeMBPerSec ? 1 : 0;
+            for (int i = 0; i < 3; ++i) rcfg.thread_cache_limit[i] = (size_t)g_cfg.threadCacheKB[i] * 1024;
+            g_spansInArena = g_cfg.rpmallocInArena && HighVAAPI::IsActive();
+            rpmalloc_initialize_config(&g_spanInterface, &rcfg);
+            LOGI("rpmalloc: span geometry=%d (%s) arena=%d", rcfg.span_geometry,
+                 rcfg.span_geometry == RPMALLOC_SPAN_GEOMETRY_COMPACT ? "4MB spans" : "256MB spans", g_spansInArena ? 1 : 0);
+            g_largeThresholdBytes = (SIZE_T)g_cfg.largeAllocThresholdMB * 1024ull * 1024ull;
+            BigBlocks::Options bo; bo.cache_bytes = (SIZE_T)g_cfg.bigBlockCacheMB * 1024 * 1024;
+            BigBlocks::Init(bo);
+            LOGI("rpmalloc thread cache: %u/%u/%u KB", (unsigned)(rcfg.thread_cache_limit[0] >> 10),
+                 (unsigned)(rcfg.thread_cache_limit[1] >> 10), (unsigned)(rcfg.thread_cache_limit[2] >> 10));
+            if (rcfg.enable_scavenger || g_cfg.threadIdleTrimSec) {
+                StartScavenger();
+                LOGI("rpmalloc scavenger: %u MB/s, age %u ms, idle trim %u s, thread=%d", g_cfg.scavengeMBPerSec,
+                     g_cfg.scavengeAgeMs, g_cfg.threadIdleTrimSec, g_scavengerThread ? 1 : 0);
+            }
+
+            SelectHookVariants();
             InstallAllocatorHooks();
             InstallHooksAcrossModules();
             ApplyLoadedConfig();
@@ -754,6 +1069,11 @@ static void MessageHandler(NVSEMessagingInterface::Message* msg) {
             LONG f = InterlockedIncrement(&g_frame);
             if ((uint32_t)f % period == 0) AdjustBudgetsDynamically(g_ema_ms);
             // Housekeeping
+            if (g_cfg.collectPeriodFrames && (uint32_t)f % g_cfg.collectPeriodFrames == 0) {
+                UpdateAllocatorPressure();
+                rpmalloc_thread_collect();
+                BigBlocks::Trim(rpmalloc_memory_pressure() ? 0 : kBigBlockCacheAgeMs);
+            }
             WriteTelemetryIfDue();
             // Backpressure: if kept committed exceeds quota, flush
             {
@@ -782,8 +1102,17 @@ static bool Cmd_GetBudgets_Execute(COMMAND_ARGS) {
 }
 static bool Cmd_DumpHeaps_Execute(COMMAND_ARGS) {
     VirtualFreeStats vfs{}; GetVirtualFreeStats(&vfs);
+    CounterTotals ct = ReadCounters();
+    if (!g_cfg.countAllocations) LOGI("Heaps: allocation counters disabled (bCountAllocations=0)");
+    if (g_cfg.detectCrossModuleMismatch) {
+        MismatchTracker::Stats ms{}; MismatchTracker::GetStats(&ms);
+        LOGI("Mismatch tracker: tracked=%ld dropped=%ld mismatches=%ld", ms.tracked, ms.dropped, ms.mismatches);
+    }
+    BigBlocks::Stats bs{}; BigBlocks::GetStats(&bs);
+    LOGI("Big blocks: live=%zu (%zu KB) cached=%zu (%zu KB) reused=%ld in_place=%ld", bs.live_blocks, bs.live_bytes >> 10,
+         bs.cached_blocks, bs.cached_bytes >> 10, bs.reused, bs.in_place);
     LOGI("Heaps: allocs=%lld frees=%lld bytes_alloc=%lld bytes_free=%lld vfree_calls=%ld kept=%zu",
-         (long long)g_allocs,(long long)g_frees,(long long)g_bytes_alloc,(long long)g_bytes_free,vfs.total_calls,vfs.bytes_kept_committed);
+         (long long)ct.allocs,(long long)ct.frees,(long long)ct.bytes_alloc,(long long)ct.bytes_free,vfs.total_calls,vfs.bytes_kept_committed);
     if (result) *result=1.0; return true;
 }
 
@@ -839,7 +1168,9 @@ case DLL_PROCESS_ATTACH: DisableThreadLibraryCalls(hinst); LogInitialize(); brea
         case DLL_PROCESS_DETACH:
             FlushDelayedFrees();
             ShutdownVirtualFreeHook();
-            if (g_initialized) rpmalloc_finalize();
+            // The scavenger holds a module reference, so by now it has exited (unload) or was terminated
+            // (process exit) and the join cannot block on the loader lock
+            if (StopScavenger() && g_initialized) rpmalloc_finalize();
             break;
     }
     return TRUE;
@@ -0,0 +1,20 @@
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <stdint.h>
+#include <string.h>
+#include "OwnershipRegistry.h"
+
+namespace OwnerRegistry {
+    uint8_t g_table[kGranuleCount];
+
+    void Mark(void* base, SIZE_T size, Owner owner) {
+        if (!base || !size) return;
+        uintptr_t first = reinterpret_cast<uintptr_t>(base) >> kGranuleShift;
+        uintptr_t last = (reinterpret_cast<uintptr_t>(base) + size - 1) >> kGranuleShift;
+        memset(&g_table[first], owner, last - first + 1);
+    }
+
+    void Clear(void* base, SIZE_T size) {
+        Mark(base, size, kForeign);
+    }
+}
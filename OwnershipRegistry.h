@@ -0,0 +1,30 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <stdint.h>
+
+static_assert(sizeof(void*) == 4, "This code targets 32-bit processes.");
+
+// Pointer ownership registry: one byte per 64KB allocation granule of the 32-bit address space.
+// Every region Overdrive maps for rpmalloc or the big-block path is tagged here, so a free can be
+// classified with a single table load instead of probing the pointer under SEH.
+namespace OwnerRegistry {
+    enum Owner : uint8_t {
+        kForeign  = 0, // not mapped by Overdrive (CRT heap, game heaps, ...)
+        kRpmalloc = 1, // rpmalloc span, huge block or heap control block
+        kBig      = 2, // BigAlloc region
+    };
+
+    static const unsigned kGranuleShift = 16;
+    static const size_t   kGranuleCount = size_t(1) << (32 - kGranuleShift);
+
+    extern uint8_t g_table[kGranuleCount];
+
+    // Tag/untag every granule overlapping [base, base + size)
+    void Mark(void* base, SIZE_T size, Owner owner);
+    void Clear(void* base, SIZE_T size);
+
+    inline Owner Lookup(const void* p) {
+        return (Owner)g_table[reinterpret_cast<uintptr_t>(p) >> kGranuleShift];
+    }
+}
@@ -66,6 +66,7 @@ static DWORD fls_key;
 #include <sched.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <time.h>
 static pthread_key_t pthread_key;
 #ifdef __FreeBSD__
 #include <sys/sysctl.h>
@@ -150,6 +151,14 @@ madvise(caddr_t, size_t, int);
 //! Enable statistics
 #define ENABLE_STATISTICS 0
 #endif
+#ifndef HUGE_CACHE_MAX_AGE_MS
+//! Milliseconds a freed huge block is kept in the huge block cache before being unmapped
+#define HUGE_CACHE_MAX_AGE_MS 2000
+#endif
+#ifndef HUGE_REALLOC_RESERVE_LIMIT
+//! Maximum virtual address space reserved past a huge block grown by reallocation
+#define HUGE_REALLOC_RESERVE_LIMIT ((size_t)(ARCH_32BIT ? 16 : 256) * 1024 * 1024)
+#endif
 
 ////////////
 ///
@@ -162,27 +171,44 @@ madvise(caddr_t, size_t, int);
 
 #define SMALL_GRANULARITY 16
 
-#define SMALL_BLOCK_SIZE_LIMIT (4 * 1024)
-#define MEDIUM_BLOCK_SIZE_LIMIT (256 * 1024)
-#define LARGE_BLOCK_SIZE_LIMIT (8 * 1024 * 1024)
+#ifndef ENABLE_TINY_GRANULARITY
+//! Enable 8 byte granularity size classes for blocks up to TINY_SIZE_LIMIT, default on 32-bit where
+//  the natural malloc alignment is 8 bytes. Blocks are then only guaranteed 8 byte alignment.
+#define ENABLE_TINY_GRANULARITY ARCH_32BIT
+#endif
 
-#define SMALL_SIZE_CLASS_COUNT 73
-#define MEDIUM_SIZE_CLASS_COUNT 24
-#define LARGE_SIZE_CLASS_COUNT 20
-#define SIZE_CLASS_COUNT (SMALL_SIZE_CLASS_COUNT + MEDIUM_SIZE_CLASS_COUNT + LARGE_SIZE_CLASS_COUNT)
+#if ENABLE_TINY_GRANULARITY
+#define TINY_GRANULARITY 8
+#define TINY_SIZE_LIMIT 128
+//! Number of size classes added by the tiny granularity tier
+#define TINY_CLASS_EXTRA ((TINY_SIZE_LIMIT / TINY_GRANULARITY) - (TINY_SIZE_LIMIT / SMALL_GRANULARITY))
+//! Alignment guaranteed for any block
+#define BLOCK_MIN_ALIGNMENT TINY_GRANULARITY
+#else
+#define TINY_CLASS_EXTRA 0
+#define BLOCK_MIN_ALIGNMENT SMALL_GRANULARITY
+#endif
 
-#define SMALL_PAGE_SIZE_SHIFT 16
-#define SMALL_PAGE_SIZE (1 << SMALL_PAGE_SIZE_SHIFT)
-#define SMALL_PAGE_MASK (~((uintptr_t)SMALL_PAGE_SIZE - 1))
-#define MEDIUM_PAGE_SIZE_SHIFT 22
-#define MEDIUM_PAGE_SIZE (1 << MEDIUM_PAGE_SIZE_SHIFT)
-#define MEDIUM_PAGE_MASK (~((uintptr_t)MEDIUM_PAGE_SIZE - 1))
-#define LARGE_PAGE_SIZE_SHIFT 26
-#define LARGE_PAGE_SIZE (1 << LARGE_PAGE_SIZE_SHIFT)
-#define LARGE_PAGE_MASK (~((uintptr_t)LARGE_PAGE_SIZE - 1))
+//! Size class table generated from an allocation size histogram by tools/sizeclassgen, used instead of the
+//  built in geometric table when found next to this file or named by RPMALLOC_SIZE_CLASS_HEADER
+#if !defined(RPMALLOC_SIZE_CLASS_HEADER) && defined(__has_include)
+#if __has_include("rpmalloc_size_classes.h")
+#define RPMALLOC_SIZE_CLASS_HEADER "rpmalloc_size_classes.h"
+#endif
+#endif
+#ifdef RPMALLOC_SIZE_CLASS_HEADER
+#include RPMALLOC_SIZE_CLASS_HEADER
+#endif
 
-#define SPAN_SIZE (256 * 1024 * 1024)
-#define SPAN_MASK (~((uintptr_t)(SPAN_SIZE - 1)))
+#ifdef RPMALLOC_GENERATED_SIZE_CLASSES
+#define ENABLE_GENERATED_SIZE_CLASSES 1
+#define SIZE_CLASS_COUNT RPMALLOC_GENERATED_SIZE_CLASS_COUNT
+#else
+#define ENABLE_GENERATED_SIZE_CLASSES 0
+//! Total number of size classes, the classes served by each page type (and the limit above which blocks
+//  are huge) depend on the span geometry selected at initialization
+#define SIZE_CLASS_COUNT (117 + TINY_CLASS_EXTRA)
+#endif
 
 ////////////
 ///
@@ -233,8 +259,12 @@ madvise(caddr_t, size_t, int);
 #if ENABLE_STATISTICS
 
 typedef struct rpmalloc_statistics_t {
-	atomic_size_t page_mapped;
-	atomic_size_t page_mapped_peak;
+	atomic_size_t mapped;
+	atomic_size_t mapped_peak;
+	atomic_size_t mapped_total;
+	atomic_size_t unmapped_total;
+	atomic_size_t huge_alloc;
+	atomic_size_t huge_alloc_peak;
 	atomic_size_t page_commit;
 	atomic_size_t page_decommit;
 	atomic_size_t page_active;
@@ -244,8 +274,42 @@ typedef struct rpmalloc_statistics_t {
 
 static rpmalloc_statistics_t global_statistics;
 
+static inline void
+statistics_add_peak(atomic_size_t* counter, atomic_size_t* peak, size_t value) {
+	size_t current = atomic_fetch_add_explicit(counter, value, memory_order_relaxed) + value;
+	size_t current_peak = atomic_load_explicit(peak, memory_order_relaxed);
+	while (current > current_peak) {
+		if (atomic_compare_exchange_weak_explicit(peak, &current_peak, current, memory_order_relaxed,
+		                                          memory_order_relaxed))
+			break;
+	}
+}
+
+//! Account memory mapped through the memory interface
+static inline void
+statistics_map(size_t size) {
+	statistics_add_peak(&global_statistics.mapped, &global_statistics.mapped_peak, size);
+	atomic_fetch_add_explicit(&global_statistics.mapped_total, size, memory_order_relaxed);
+}
+
+//! Account memory unmapped through the memory interface
+static inline void
+statistics_unmap(size_t size) {
+	atomic_fetch_sub_explicit(&global_statistics.mapped, size, memory_order_relaxed);
+	atomic_fetch_add_explicit(&global_statistics.unmapped_total, size, memory_order_relaxed);
+}
+
+#define statistics_huge_alloc(size) \
+	statistics_add_peak(&global_statistics.huge_alloc, &global_statistics.huge_alloc_peak, size)
+#define statistics_huge_free(size) atomic_fetch_sub_explicit(&global_statistics.huge_alloc, size, memory_order_relaxed)
+
 #else
 
+#define statistics_map(size) ((void)sizeof(size))
+#define statistics_unmap(size) ((void)sizeof(size))
+#define statistics_huge_alloc(size) ((void)sizeof(size))
+#define statistics_huge_free(size) ((void)sizeof(size))
+
 #endif
 
 ////////////
@@ -354,9 +418,9 @@ typedef struct size_class_t size_class_t;
 
 //! Memory page type
 typedef enum page_type_t {
-	PAGE_SMALL,   // 64KiB
-	PAGE_MEDIUM,  // 4MiB
-	PAGE_LARGE,   // 64MiB
+	PAGE_SMALL,   // 64KiB (16KiB compact)
+	PAGE_MEDIUM,  // 4MiB (256KiB compact)
+	PAGE_LARGE,   // 64MiB (2MiB compact)
 	PAGE_HUGE
 } page_type_t;
 
@@ -400,8 +464,12 @@ struct page_t {
 	uint32_t has_aligned_block : 1;
 	//! Fast combination flag for either huge, fully allocated or has aligned blocks
 	uint32_t generic_free : 1;
-	//! Local free list count
-	uint32_t local_free_count;
+	union {
+		//! Local free list count
+		uint32_t local_free_count;
+		//! Tick when a free page was put in the global page cache
+		uint32_t free_tick;
+	};
 	//! Local free list
 	block_t* local_free;
 	//! Owning heap
@@ -422,8 +490,12 @@ struct span_t {
 	heap_t* heap;
 	//! Page address mask
 	uintptr_t page_address_mask;
-	//! Number of pages initialized
-	uint32_t page_initialized;
+	union {
+		//! Number of pages initialized
+		uint32_t page_initialized;
+		//! Tick when a huge span was put in the huge block cache
+		uint32_t cache_tick;
+	};
 	//! Number of pages in use
 	uint32_t page_count;
 	//! Number of bytes per page
@@ -438,6 +510,57 @@ struct span_t {
 	span_t* next;
 };
 
+#if ENABLE_STATISTICS
+//! Heap statistics, only modified by the thread owning the heap. Blocks freed by other threads are
+//  counted when the owning thread adopts them from the thread free lists.
+typedef struct heap_statistics_t {
+	//! Bytes of free pages handed to the global cache
+	size_t thread_to_global;
+	//! Bytes of free pages taken from the global cache
+	size_t global_to_thread;
+	//! Per page type span counters
+	struct {
+		size_t current;
+		size_t peak;
+		size_t to_global;
+		size_t from_global;
+		size_t map_calls;
+	} span_use[4];
+	//! Per size class block and page counters
+	struct {
+		size_t alloc_total;
+		size_t alloc_peak;
+		size_t free_total;
+		size_t page_to_free;
+		size_t page_from_free;
+		size_t page_from_span;
+		size_t map_calls;
+	} size_use[SIZE_CLASS_COUNT];
+} heap_statistics_t;
+#endif
+
+//! Number of occupancy buckets available pages are ordered by at collect
+#define PAGE_OCCUPANCY_BUCKETS 4
+
+//! Number of pages a thread heap buffers blocks freed to other threads for
+#define REMOTE_FREE_PAGE_COUNT 8
+//! Number of buffered blocks for a page that triggers handing them to the owning thread
+#define REMOTE_FREE_BLOCK_LIMIT 32
+//! Number of buffered bytes for a page that triggers handing them to the owning thread
+#define REMOTE_FREE_BYTE_LIMIT (64 * 1024)
+
+//! Blocks freed by this thread to a page owned by another thread, linked and not yet handed over
+typedef struct remote_free_t {
+	//! Page owning the blocks, null if unused
+	page_t* page;
+	//! First block in list
+	block_t* first;
+	//! Last block in list
+	block_t* last;
+	//! Number of blocks in list
+	uint32_t count;
+} remote_free_t;
+
 // Control structure for a heap, either a thread heap or a first class heap if enabled
 struct heap_t {
 	//! Owning thread ID
@@ -450,16 +573,24 @@ struct heap_t {
 	page_t* page_free[3];
 	//! Free but still committed page count for each page tyoe
 	uint32_t page_free_commit_count[3];
+	//! Lock for the free page lists, taken when pages move in or out and by idle heap trimming
+	atomic_uint page_free_lock;
+	//! Tick of the last page level activity of the owning thread
+	atomic_uint active_tick;
 	//! Multithreaded free list
 	atomic_uintptr_t thread_free[3];
 	//! Available partially initialized spans for each page type
 	span_t* span_partial[3];
 	//! Spans in full use for each page type
 	span_t* span_used[4];
-	//! Next heap in queue
+	//! Blocks freed to pages of other threads, buffered to hand over a list per page at a time
+	remote_free_t remote_free[REMOTE_FREE_PAGE_COUNT];
+	//! Next remote free buffer to hand over when all are in use
+	uint32_t remote_free_next;
+	//! Next heap in free heap stack
 	heap_t* next;
-	//! Previous heap in queue
-	heap_t* prev;
+	//! Next heap in list of all heaps
+	heap_t* next_heap;
 	//! Heap ID
 	uint32_t id;
 	//! Finalization state flag
@@ -468,11 +599,49 @@ struct heap_t {
 	uint32_t offset;
 	//! Memory map size
 	size_t mapped_size;
+#if ENABLE_STATISTICS
+	//! Statistics
+	heap_statistics_t statistics;
+#endif
 };
 
 _Static_assert(sizeof(page_t) <= PAGE_HEADER_SIZE, "Invalid page header size");
 _Static_assert(sizeof(span_t) <= SPAN_HEADER_SIZE, "Invalid span header size");
-_Static_assert(sizeof(heap_t) <= 4096, "Invalid heap size");
+_Static_assert(ENABLE_STATISTICS || (sizeof(heap_t) <= 4096), "Invalid heap size");
+#if ENABLE_GENERATED_SIZE_CLASSES
+_Static_assert((RPMALLOC_GENERATED_SIZE_CLASS_GRANULARITY % BLOCK_MIN_ALIGNMENT) == 0,
+               "Generated size classes do not preserve the block alignment");
+_Static_assert(SIZE_CLASS_COUNT <= 255, "Too many generated size classes");
+#endif
+
+#if ENABLE_STATISTICS
+
+static inline void
+heap_statistics_alloc(heap_t* heap, uint32_t size_class) {
+	size_t alloc_total = ++heap->statistics.size_use[size_class].alloc_total;
+	size_t alloc_current = alloc_total - heap->statistics.size_use[size_class].free_total;
+	if (alloc_current > heap->statistics.size_use[size_class].alloc_peak)
+		heap->statistics.size_use[size_class].alloc_peak = alloc_current;
+}
+
+static inline void
+heap_statistics_span_map(heap_t* heap, page_type_t page_type) {
+	++heap->statistics.span_use[page_type].map_calls;
+	if (++heap->statistics.span_use[page_type].current > heap->statistics.span_use[page_type].peak)
+		heap->statistics.span_use[page_type].peak = heap->statistics.span_use[page_type].current;
+}
+
+#define heap_statistics_free(heap, size_class, count) ((heap)->statistics.size_use[size_class].free_total += (count))
+#define heap_statistics_inc(heap, size_class, counter) (++(heap)->statistics.size_use[size_class].counter)
+
+#else
+
+#define heap_statistics_alloc(heap, size_class) ((void)sizeof(heap))
+#define heap_statistics_span_map(heap, page_type) ((void)sizeof(heap))
+#define heap_statistics_free(heap, size_class, count) ((void)sizeof(heap))
+#define heap_statistics_inc(heap, size_class, counter) ((void)sizeof(heap))
+
+#endif
 
 ////////////
 ///
@@ -484,12 +653,10 @@ _Static_assert(sizeof(heap_t) <= 4096, "Invalid heap size");
 static RPMALLOC_CACHE_ALIGNED heap_t global_heap_fallback;
 //! Default heap
 static heap_t* global_heap_default = &global_heap_fallback;
-//! Available heaps
-static heap_t* global_heap_queue;
-//! In use heaps
-static heap_t* global_heap_used;
-//! Lock for heap queue
-static atomic_uintptr_t global_heap_lock;
+//! Available heaps, stack head packing the top heap address with an ABA tag
+static atomic_ullong global_heap_queue;
+//! All heaps, push only list linked through next_heap
+static atomic_uintptr_t global_heap_list;
 //! Heap ID counter
 static atomic_uint global_heap_id = 1;
 //! Initialized flag
@@ -503,38 +670,120 @@ static rpmalloc_config_t global_config = {0};
 //! Main thread ID
 static uintptr_t global_main_thread_id;
 
-//! Size classes
+//! Span geometry profile
+typedef struct span_geometry_t {
+	//! Size and alignment of spans
+	size_t span_size;
+	//! Size of small, medium and large pages
+	size_t page_size[3];
+	//! Largest block size served by small, medium and large pages
+	size_t block_size_limit[3];
+} span_geometry_t;
+
+//! Span geometry profiles for RPMALLOC_SPAN_GEOMETRY_LARGE and RPMALLOC_SPAN_GEOMETRY_COMPACT
+static const span_geometry_t global_span_geometry[2] = {
+    {256 * 1024 * 1024, {64 * 1024, 4 * 1024 * 1024, 64 * 1024 * 1024}, {4 * 1024, 256 * 1024, 8 * 1024 * 1024}},
+    {4 * 1024 * 1024, {16 * 1024, 256 * 1024, 2 * 1024 * 1024}, {1024, 16 * 1024, 256 * 1024}}};
+
+//! Span size
+static size_t global_span_size = 256 * 1024 * 1024;
+//! Span address mask
+static uintptr_t global_span_mask = ~((uintptr_t)(256 * 1024 * 1024) - 1);
+//! Page size for each page type
+static size_t global_page_size[3] = {64 * 1024, 4 * 1024 * 1024, 64 * 1024 * 1024};
+//! Page address mask for each page type
+static uintptr_t global_page_mask[3] = {~((uintptr_t)(64 * 1024) - 1), ~((uintptr_t)(4 * 1024 * 1024) - 1),
+                                        ~((uintptr_t)(64 * 1024 * 1024) - 1)};
+//! Largest block size served by each page type, anything above the large limit is a huge block
+static size_t global_block_size_limit[3] = {4 * 1024, 256 * 1024, 8 * 1024 * 1024};
+//! End of the size class range served by each page type
+#if ENABLE_GENERATED_SIZE_CLASSES
+static uint32_t global_size_class_limit[3];
+
+#define GCLASS(n) \
+	{ (n), 0 }
+//! Size classes, block counts are filled in from the span geometry at initialization
+static size_class_t global_size_class[SIZE_CLASS_COUNT] = {RPMALLOC_GENERATED_SIZE_CLASSES};
+#undef GCLASS
+
+//! Size class of sizes up to 64 times the small granularity, indexed by size in 8 byte units
+static const uint8_t global_size_class_map[((SMALL_GRANULARITY * 64) / 8) + 1] = {RPMALLOC_GENERATED_SIZE_CLASS_MAP};
+#else
+static uint32_t global_size_class_limit[3] = {73 + TINY_CLASS_EXTRA, 97 + TINY_CLASS_EXTRA, 117 + TINY_CLASS_EXTRA};
+
+//! Size classes, block counts are filled in from the span geometry at initialization
 #define SCLASS(n) \
-	{ (n * SMALL_GRANULARITY), (SMALL_PAGE_SIZE - PAGE_HEADER_SIZE) / (n * SMALL_GRANULARITY) }
-#define MCLASS(n) \
-	{ (n * SMALL_GRANULARITY), (MEDIUM_PAGE_SIZE - PAGE_HEADER_SIZE) / (n * SMALL_GRANULARITY) }
-#define LCLASS(n) \
-	{ (n * SMALL_GRANULARITY), (LARGE_PAGE_SIZE - PAGE_HEADER_SIZE) / (n * SMALL_GRANULARITY) }
-static const size_class_t global_size_class[SIZE_CLASS_COUNT] = {
+	{ (n * SMALL_GRANULARITY), 0 }
+#define TCLASS(n) \
+	{ (n * TINY_GRANULARITY), 0 }
+static size_class_t global_size_class[SIZE_CLASS_COUNT] = {
+#if ENABLE_TINY_GRANULARITY
+    TCLASS(1),      TCLASS(1),      TCLASS(2),      TCLASS(3),      TCLASS(4),      TCLASS(5),      TCLASS(6),
+    TCLASS(7),      TCLASS(8),      TCLASS(9),      TCLASS(10),     TCLASS(11),     TCLASS(12),     TCLASS(13),
+    TCLASS(14),     TCLASS(15),     TCLASS(16),
+#else
     SCLASS(1),      SCLASS(1),      SCLASS(2),      SCLASS(3),      SCLASS(4),      SCLASS(5),      SCLASS(6),
-    SCLASS(7),      SCLASS(8),      SCLASS(9),      SCLASS(10),     SCLASS(11),     SCLASS(12),     SCLASS(13),
-    SCLASS(14),     SCLASS(15),     SCLASS(16),     SCLASS(17),     SCLASS(18),     SCLASS(19),     SCLASS(20),
-    SCLASS(21),     SCLASS(22),     SCLASS(23),     SCLASS(24),     SCLASS(25),     SCLASS(26),     SCLASS(27),
-    SCLASS(28),     SCLASS(29),     SCLASS(30),     SCLASS(31),     SCLASS(32),     SCLASS(33),     SCLASS(34),
-    SCLASS(35),     SCLASS(36),     SCLASS(37),     SCLASS(38),     SCLASS(39),     SCLASS(40),     SCLASS(41),
-    SCLASS(42),     SCLASS(43),     SCLASS(44),     SCLASS(45),     SCLASS(46),     SCLASS(47),     SCLASS(48),
-    SCLASS(49),     SCLASS(50),     SCLASS(51),     SCLASS(52),     SCLASS(53),     SCLASS(54),     SCLASS(55),
-    SCLASS(56),     SCLASS(57),     SCLASS(58),     SCLASS(59),     SCLASS(60),     SCLASS(61),     SCLASS(62),
-    SCLASS(63),     SCLASS(64),     SCLASS(80),     SCLASS(96),     SCLASS(112),    SCLASS(128),    SCLASS(160),
-    SCLASS(192),    SCLASS(224),    SCLASS(256),    MCLASS(320),    MCLASS(384),    MCLASS(448),    MCLASS(512),
-    MCLASS(640),    MCLASS(768),    MCLASS(896),    MCLASS(1024),   MCLASS(1280),   MCLASS(1536),   MCLASS(1792),
-    MCLASS(2048),   MCLASS(2560),   MCLASS(3072),   MCLASS(3584),   MCLASS(4096),   MCLASS(5120),   MCLASS(6144),
-    MCLASS(7168),   MCLASS(8192),   MCLASS(10240),  MCLASS(12288),  MCLASS(14336),  MCLASS(16384),  LCLASS(20480),
-    LCLASS(24576),  LCLASS(28672),  LCLASS(32768),  LCLASS(40960),  LCLASS(49152),  LCLASS(57344),  LCLASS(65536),
-    LCLASS(81920),  LCLASS(98304),  LCLASS(114688), LCLASS(131072), LCLASS(163840), LCLASS(196608), LCLASS(229376),
-    LCLASS(262144), LCLASS(327680), LCLASS(393216), LCLASS(458752), LCLASS(524288)};
-
-//! Threshold number of pages for when free pages are decommitted
+    SCLASS(7),      SCLASS(8),
+#endif
+    SCLASS(9),      SCLASS(10),     SCLASS(11),     SCLASS(12),     SCLASS(13),     SCLASS(14),     SCLASS(15),
+    SCLASS(16),     SCLASS(17),     SCLASS(18),     SCLASS(19),     SCLASS(20),     SCLASS(21),     SCLASS(22),
+    SCLASS(23),     SCLASS(24),     SCLASS(25),     SCLASS(26),     SCLASS(27),     SCLASS(28),     SCLASS(29),
+    SCLASS(30),     SCLASS(31),     SCLASS(32),     SCLASS(33),     SCLASS(34),     SCLASS(35),     SCLASS(36),
+    SCLASS(37),     SCLASS(38),     SCLASS(39),     SCLASS(40),     SCLASS(41),     SCLASS(42),     SCLASS(43),
+    SCLASS(44),     SCLASS(45),     SCLASS(46),     SCLASS(47),     SCLASS(48),     SCLASS(49),     SCLASS(50),
+    SCLASS(51),     SCLASS(52),     SCLASS(53),     SCLASS(54),     SCLASS(55),     SCLASS(56),     SCLASS(57),
+    SCLASS(58),     SCLASS(59),     SCLASS(60),     SCLASS(61),     SCLASS(62),     SCLASS(63),     SCLASS(64),
+    SCLASS(80),     SCLASS(96),     SCLASS(112),    SCLASS(128),    SCLASS(160),    SCLASS(192),    SCLASS(224),
+    SCLASS(256),    SCLASS(320),    SCLASS(384),    SCLASS(448),    SCLASS(512),    SCLASS(640),    SCLASS(768),
+    SCLASS(896),    SCLASS(1024),   SCLASS(1280),   SCLASS(1536),   SCLASS(1792),   SCLASS(2048),   SCLASS(2560),
+    SCLASS(3072),   SCLASS(3584),   SCLASS(4096),   SCLASS(5120),   SCLASS(6144),   SCLASS(7168),   SCLASS(8192),
+    SCLASS(10240),  SCLASS(12288),  SCLASS(14336),  SCLASS(16384),  SCLASS(20480),  SCLASS(24576),  SCLASS(28672),
+    SCLASS(32768),  SCLASS(40960),  SCLASS(49152),  SCLASS(57344),  SCLASS(65536),  SCLASS(81920),  SCLASS(98304),
+    SCLASS(114688), SCLASS(131072), SCLASS(163840), SCLASS(196608), SCLASS(229376), SCLASS(262144), SCLASS(327680),
+    SCLASS(393216), SCLASS(458752), SCLASS(524288)};
+#endif
+
+//! Threshold number of pages for when free pages are decommitted, without memory pressure
 static uint32_t global_page_free_overflow[4] = {16, 8, 2, 0};
 
-//! Number of pages to retain when free page threshold overflows
+//! Number of pages to retain when free page threshold overflows, without memory pressure
 static uint32_t global_page_free_retain[4] = {4, 2, 1, 0};
 
+//! Current memory pressure level, each level halves free page retention and quarters the huge block cache
+static atomic_uint global_memory_pressure;
+
+//! Number of slots in the global page cache for each page type
+#define GLOBAL_PAGE_CACHE_SLOTS 64
+//! Number of slots in the global span cache for each page type
+#define GLOBAL_SPAN_CACHE_SLOTS 16
+
+//! Maximum number of free pages held in the global page cache for each page type
+static int global_page_cache_limit[3] = {64, 16, 4};
+//! Free pages released by heaps of exited threads, shared by all thread heaps
+static atomic_uintptr_t global_page_cache[3][GLOBAL_PAGE_CACHE_SLOTS];
+//! Number of pages in the global page cache for each page type
+static atomic_int global_page_cache_count[3];
+//! Partially initialized spans released by heaps of exited threads, shared by all thread heaps
+static atomic_uintptr_t global_span_cache[3][GLOBAL_SPAN_CACHE_SLOTS];
+//! Number of spans in the global span cache for each page type
+static atomic_int global_span_cache_count[3];
+
+//! Number of buckets in the huge block cache, one for each power of two size
+#define HUGE_CACHE_BUCKET_COUNT (sizeof(size_t) * 8)
+
+//! Freed huge spans kept mapped for reuse, bucketed by size and linked newest first through the page header links
+static span_t* global_huge_cache[HUGE_CACHE_BUCKET_COUNT];
+//! Oldest span in each huge block cache bucket
+static span_t* global_huge_cache_tail[HUGE_CACHE_BUCKET_COUNT];
+//! Total bytes mapped by spans in the huge block cache
+static atomic_size_t global_huge_cache_size;
+//! Maximum bytes held in the huge block cache, 0 if disabled
+static size_t global_huge_cache_limit;
+//! Lock for the huge block cache
+static atomic_uintptr_t global_huge_cache_lock;
+//! Set if address space reserved past a huge block can be left uncommitted until the block grows into it
+static int global_huge_reserve_uncommitted;
+
 //! OS huge page support
 static int os_huge_pages;
 //! OS memory map granularity
@@ -635,22 +884,57 @@ get_thread_heap(void) {
 	return global_thread_heap;
 }
 
-//! Get the size class from given size in bytes for tiny blocks (below 16 times the minimum granularity)
+#if ENABLE_GENERATED_SIZE_CLASSES
+
+//! Get the size class from given size in bytes for tiny blocks (up to 64 times the small granularity)
 static inline uint32_t
 get_size_class_tiny(size_t size) {
-	return (((uint32_t)size + (SMALL_GRANULARITY - 1)) / SMALL_GRANULARITY);
+	return global_size_class_map[(size + 7) / 8];
+}
+
+//! Get the size class from given size in bytes, SIZE_CLASS_COUNT if above the largest class
+static inline uint32_t
+get_size_class(size_t size) {
+	if (size <= (SMALL_GRANULARITY * 64))
+		return get_size_class_tiny(size);
+	// Generated classes follow no formula, binary search the classes above the direct map
+	uint32_t low = global_size_class_map[(SMALL_GRANULARITY * 64) / 8] + 1;
+	uint32_t high = SIZE_CLASS_COUNT;
+	while (low < high) {
+		uint32_t mid = (low + high) / 2;
+		if (global_size_class[mid].block_size < size)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	rpmalloc_assert((low >= SIZE_CLASS_COUNT) || (global_size_class[low].block_size >= size),
+	                "Size class misconfiguration");
+	return low;
+}
+
+#else
+
+//! Get the size class from given size in bytes for tiny blocks (up to 64 times the small granularity)
+static inline uint32_t
+get_size_class_tiny(size_t size) {
+#if ENABLE_TINY_GRANULARITY
+	if (size <= TINY_SIZE_LIMIT)
+		return (((uint32_t)size + (TINY_GRANULARITY - 1)) / TINY_GRANULARITY);
+#endif
+	return (((uint32_t)size + (SMALL_GRANULARITY - 1)) / SMALL_GRANULARITY) + TINY_CLASS_EXTRA;
 }
 
 //! Get the size class from given size in bytes
 static inline uint32_t
 get_size_class(size_t size) {
-	uintptr_t minblock_count = (size + (SMALL_GRANULARITY - 1)) / SMALL_GRANULARITY;
 	// For sizes up to 64 times the minimum granularity (i.e 1024 bytes) the size class is equal to number of such
-	// blocks
+	// blocks, offset by the extra classes of the tiny granularity tier
 	if (size <= (SMALL_GRANULARITY * 64)) {
-		rpmalloc_assert(global_size_class[minblock_count].block_size >= size, "Size class misconfiguration");
-		return (uint32_t)(minblock_count ? minblock_count : 1);
+		uint32_t size_class = get_size_class_tiny(size);
+		rpmalloc_assert(global_size_class[size_class].block_size >= size, "Size class misconfiguration");
+		return size_class ? size_class : 1;
 	}
+	uintptr_t minblock_count = (size + (SMALL_GRANULARITY - 1)) / SMALL_GRANULARITY;
 	--minblock_count;
 	// Calculate position of most significant bit, since minblock_count now guaranteed to be > 64 this position is
 	// guaranteed to be >= 6
@@ -662,7 +946,7 @@ get_size_class(size_t size) {
 	// Class sizes are of the bit format [..]000xxx000[..] where we already have the position of the most significant
 	// bit, now calculate the subclass from the remaining two bits
 	const uint32_t subclass_bits = (minblock_count >> (most_significant_bit - 2)) & 0x03;
-	const uint32_t class_idx = (uint32_t)((most_significant_bit << 2) + subclass_bits) + 41;
+	const uint32_t class_idx = (uint32_t)((most_significant_bit << 2) + subclass_bits) + 41 + TINY_CLASS_EXTRA;
 	rpmalloc_assert((class_idx >= SIZE_CLASS_COUNT) || (global_size_class[class_idx].block_size >= size),
 	                "Size class misconfiguration");
 	rpmalloc_assert((class_idx >= SIZE_CLASS_COUNT) || (global_size_class[class_idx - 1].block_size < size),
@@ -670,13 +954,15 @@ get_size_class(size_t size) {
 	return class_idx;
 }
 
+#endif
+
 static inline page_type_t
 get_page_type(uint32_t size_class) {
-	if (size_class < SMALL_SIZE_CLASS_COUNT)
+	if (size_class < global_size_class_limit[PAGE_SMALL])
 		return PAGE_SMALL;
-	else if (size_class < (SMALL_SIZE_CLASS_COUNT + MEDIUM_SIZE_CLASS_COUNT))
+	else if (size_class < global_size_class_limit[PAGE_MEDIUM])
 		return PAGE_MEDIUM;
-	else if (size_class < SIZE_CLASS_COUNT)
+	else if (size_class < global_size_class_limit[PAGE_LARGE])
 		return PAGE_LARGE;
 	return PAGE_HUGE;
 }
@@ -712,18 +998,40 @@ os_set_page_name(void* address, size_t size) {
 
 static void*
 os_mmap(size_t size, size_t alignment, size_t* offset, size_t* mapped_size) {
+	// Mappings are always aligned to the map granularity, only larger alignments need padding
+	if (alignment <= os_map_granularity)
+		alignment = 0;
 	size_t map_size = size + alignment;
 #if PLATFORM_WINDOWS
 	// Ok to MEM_COMMIT - according to MSDN, "actual physical pages are not allocated unless/until the virtual addresses
 	// are actually accessed". But if we enable decommit it's better to not immediately commit and instead commit per
 	// page to avoid saturating the OS commit limit
 #if ENABLE_DECOMMIT
-	DWORD do_commit = 0;
+	DWORD do_commit = global_config.disable_decommit ? MEM_COMMIT : 0;
 #else
 	DWORD do_commit = MEM_COMMIT;
 #endif
-	void* ptr =
-	    VirtualAlloc(0, map_size, (os_huge_pages ? MEM_LARGE_PAGES : 0) | MEM_RESERVE | do_commit, PAGE_READWRITE);
+	DWORD alloc_type = (os_huge_pages ? MEM_LARGE_PAGES : 0) | MEM_RESERVE | do_commit;
+	void* ptr = 0;
+	if (alignment) {
+		// Find an aligned address by reserving a padded region, then release it and reserve exactly
+		// the aligned range. Another thread can grab the range in between, retry a few times before
+		// falling back to keeping the padded region
+		for (int attempt = 0; !ptr && (attempt < 8); ++attempt) {
+			void* probe = VirtualAlloc(0, map_size, MEM_RESERVE, PAGE_NOACCESS);
+			if (!probe)
+				break;
+			uintptr_t aligned = ((uintptr_t)probe + (alignment - 1)) & ~(uintptr_t)(alignment - 1);
+			VirtualFree(probe, 0, MEM_RELEASE);
+			ptr = VirtualAlloc((void*)aligned, size, alloc_type, PAGE_READWRITE);
+		}
+		if (ptr) {
+			map_size = size;
+			alignment = 0;
+		}
+	}
+	if (!ptr)
+		ptr = VirtualAlloc(0, map_size, alloc_type, PAGE_READWRITE);
 #else
 	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_UNINITIALIZED;
 #if defined(__APPLE__) && !TARGET_OS_IPHONE && !TARGET_OS_SIMULATOR
@@ -768,6 +1076,7 @@ os_mmap(size_t size, size_t alignment, size_t* offset, size_t* mapped_size) {
 		}
 		return 0;
 	}
+	*offset = 0;
 	if (alignment) {
 		size_t padding = ((uintptr_t)ptr & (uintptr_t)(alignment - 1));
 		if (padding)
@@ -775,29 +1084,24 @@ os_mmap(size_t size, size_t alignment, size_t* offset, size_t* mapped_size) {
 		rpmalloc_assert(padding <= alignment, "Internal failure in padding");
 		rpmalloc_assert(!(padding % 8), "Internal failure in padding");
 		ptr = pointer_offset(ptr, padding);
+#if PLATFORM_POSIX
+		if (!os_huge_pages) {
+			// Trim the unaligned head and tail so the mapping covers exactly the aligned range
+			size_t tail = alignment - padding;
+			if (padding)
+				munmap(pointer_offset(ptr, -(ptrdiff_t)padding), padding);
+			if (tail)
+				munmap(pointer_offset(ptr, size), tail);
+			map_size = size;
+			padding = 0;
+		}
+#endif
 		*offset = padding;
 	}
 	*mapped_size = map_size;
-#if ENABLE_STATISTICS
-	size_t page_count = map_size / global_config.page_size;
-	size_t page_mapped_current =
-	    atomic_fetch_add_explicit(&global_statistics.page_mapped, page_count, memory_order_relaxed) + page_count;
-	size_t page_mapped_peak = atomic_load_explicit(&global_statistics.page_mapped_peak, memory_order_relaxed);
-	while (page_mapped_current > page_mapped_peak) {
-		if (atomic_compare_exchange_weak_explicit(&global_statistics.page_mapped_peak, &page_mapped_peak,
-		                                          page_mapped_current, memory_order_relaxed, memory_order_relaxed))
-			break;
-	}
-#if ENABLE_DECOMMIT
-	size_t page_active_current =
-	    atomic_fetch_add_explicit(&global_statistics.page_active, page_count, memory_order_relaxed) + page_count;
-	size_t page_active_peak = atomic_load_explicit(&global_statistics.page_active_peak, memory_order_relaxed);
-	while (page_active_current > page_active_peak) {
-		if (atomic_compare_exchange_weak_explicit(&global_statistics.page_active_peak, &page_active_peak,
-		                                          page_active_current, memory_order_relaxed, memory_order_relaxed))
-			break;
-	}
-#endif
+#if ENABLE_STATISTICS && ENABLE_DECOMMIT
+	statistics_add_peak(&global_statistics.page_active, &global_statistics.page_active_peak,
+	                    map_size / global_config.page_size);
 #endif
 	return ptr;
 }
@@ -821,14 +1125,7 @@ os_mcommit(void* address, size_t size) {
 #if ENABLE_STATISTICS
 	size_t page_count = size / global_config.page_size;
 	atomic_fetch_add_explicit(&global_statistics.page_commit, page_count, memory_order_relaxed);
-	size_t page_active_current =
-	    atomic_fetch_add_explicit(&global_statistics.page_active, page_count, memory_order_relaxed) + page_count;
-	size_t page_active_peak = atomic_load_explicit(&global_statistics.page_active_peak, memory_order_relaxed);
-	while (page_active_current > page_active_peak) {
-		if (atomic_compare_exchange_weak_explicit(&global_statistics.page_active_peak, &page_active_peak,
-		                                          page_active_current, memory_order_relaxed, memory_order_relaxed))
-			break;
-	}
+	statistics_add_peak(&global_statistics.page_active, &global_statistics.page_active_peak, page_count);
 #endif
 #endif
 	(void)sizeof(address);
@@ -881,6 +1178,18 @@ os_mdecommit(void* address, size_t size) {
 #endif
 }
 
+//! Millisecond tick counter, wraps around
+static uint32_t
+os_tick_ms(void) {
+#if PLATFORM_WINDOWS
+	return (uint32_t)GetTickCount();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(((uint64_t)ts.tv_sec * 1000) + ((uint64_t)ts.tv_nsec / 1000000));
+#endif
+}
+
 static void
 os_munmap(void* address, size_t offset, size_t mapped_size) {
 	(void)sizeof(mapped_size);
@@ -894,10 +1203,9 @@ os_munmap(void* address, size_t offset, size_t mapped_size) {
 	if (munmap(address, mapped_size))
 		rpmalloc_assert(0, "Failed to unmap virtual memory block");
 #endif
-#if ENABLE_STATISTICS
-	size_t page_count = mapped_size / global_config.page_size;
-	atomic_fetch_sub_explicit(&global_statistics.page_mapped, page_count, memory_order_relaxed);
-	atomic_fetch_sub_explicit(&global_statistics.page_active, page_count, memory_order_relaxed);
+#if ENABLE_STATISTICS && ENABLE_DECOMMIT
+	atomic_fetch_sub_explicit(&global_statistics.page_active, mapped_size / global_config.page_size,
+	                          memory_order_relaxed);
 #endif
 #endif
 }
@@ -910,28 +1218,22 @@ os_munmap(void* address, size_t offset, size_t mapped_size) {
 
 static inline span_t*
 page_get_span(page_t* page) {
-	return (span_t*)((uintptr_t)page & SPAN_MASK);
+	return (span_t*)((uintptr_t)page & global_span_mask);
 }
 
 static inline size_t
 page_get_size(page_t* page) {
-	if (page->page_type == PAGE_SMALL)
-		return SMALL_PAGE_SIZE;
-	else if (page->page_type == PAGE_MEDIUM)
-		return MEDIUM_PAGE_SIZE;
-	else if (page->page_type == PAGE_LARGE)
-		return LARGE_PAGE_SIZE;
+	if (page->page_type < PAGE_HUGE)
+		return global_page_size[page->page_type];
 	else
 		return page_get_span(page)->page_size;
 }
 
+//! Check if the page is owned by the calling thread heap. Pages of first class heaps never are, blocks
+//  freed through the generic interface are handed over to the heap like blocks freed by another thread
 static inline int
 page_is_thread_heap(page_t* page) {
-#if RPMALLOC_FIRST_CLASS_HEAPS
-	return (!page->heap->owner_thread || (page->heap->owner_thread == get_thread_id()));
-#else
 	return (page->heap->owner_thread == get_thread_id());
-#endif
 }
 
 static inline block_t*
@@ -980,6 +1282,20 @@ page_get_local_free_block(page_t* page) {
 	return block;
 }
 
+//! Number of free pages of the given type a heap keeps committed before decommitting, under the current pressure
+static inline uint32_t
+page_free_overflow(uint32_t page_type) {
+	uint32_t overflow =
+	    global_page_free_overflow[page_type] >> atomic_load_explicit(&global_memory_pressure, memory_order_relaxed);
+	return overflow ? overflow : 1;
+}
+
+//! Number of free pages of the given type left committed when decommitting, under the current pressure
+static inline uint32_t
+page_free_retain(uint32_t page_type) {
+	return global_page_free_retain[page_type] >> atomic_load_explicit(&global_memory_pressure, memory_order_relaxed);
+}
+
 static inline void
 page_decommit_memory_pages(page_t* page) {
 	if (page->is_decommitted)
@@ -1010,6 +1326,17 @@ page_commit_memory_pages(page_t* page) {
 #endif
 }
 
+static inline void
+heap_page_free_lock(heap_t* heap) {
+	while (atomic_exchange_explicit(&heap->page_free_lock, 1, memory_order_acquire))
+		wait_spin();
+}
+
+static inline void
+heap_page_free_unlock(heap_t* heap) {
+	atomic_store_explicit(&heap->page_free_lock, 0, memory_order_release);
+}
+
 static void
 page_available_to_free(page_t* page) {
 	rpmalloc_assert(page->is_full == 0, "Page full flag internal failure");
@@ -1024,10 +1351,14 @@ page_available_to_free(page_t* page) {
 	}
 	page->is_free = 1;
 	page->is_zero = 0;
+	heap_statistics_inc(heap, page->size_class, page_to_free);
+	heap_page_free_lock(heap);
 	page->next = heap->page_free[page->page_type];
 	heap->page_free[page->page_type] = page;
-	if (++heap->page_free_commit_count[page->page_type] >= global_page_free_overflow[page->page_type])
-		heap_page_free_decommit(heap, page->page_type, global_page_free_retain[page->page_type]);
+	if (++heap->page_free_commit_count[page->page_type] >= page_free_overflow(page->page_type))
+		heap_page_free_decommit(heap, page->page_type, page_free_retain(page->page_type));
+	heap_page_free_unlock(heap);
+	atomic_store_explicit(&heap->active_tick, os_tick_ms(), memory_order_relaxed);
 }
 
 static void
@@ -1053,10 +1384,12 @@ page_full_to_free_on_new_heap(page_t* page, heap_t* heap) {
 	page->is_free = 1;
 	page->heap = heap;
 	atomic_store_explicit(&page->thread_free, 0, memory_order_release);
+	heap_page_free_lock(heap);
 	page->next = heap->page_free[page->page_type];
 	heap->page_free[page->page_type] = page;
-	if (++heap->page_free_commit_count[page->page_type] >= global_page_free_overflow[page->page_type])
-		heap_page_free_decommit(heap, page->page_type, global_page_free_retain[page->page_type]);
+	if (++heap->page_free_commit_count[page->page_type] >= page_free_overflow(page->page_type))
+		heap_page_free_decommit(heap, page->page_type, page_free_retain(page->page_type));
+	heap_page_free_unlock(heap);
 }
 
 static void
@@ -1099,38 +1432,112 @@ page_adopt_thread_free_block_list(page_t* page) {
 		page->local_free_count = page_block_from_thread_free_list(page, thread_free, &page->local_free);
 		rpmalloc_assert(page->local_free_count <= page->block_used, "Page thread free list count internal failure");
 		page->block_used -= page->local_free_count;
+		heap_statistics_free(page->heap, page->size_class, page->local_free_count);
 	}
 }
 
+//! Adopt blocks freed by other threads, appending to a non-empty local free list
+static void
+page_collect_thread_free_blocks(page_t* page) {
+	if (atomic_load_explicit(&page->thread_free, memory_order_relaxed) == 0)
+		return;
+	block_t* local_free = page->local_free;
+	uint32_t local_free_count = page->local_free_count;
+	page->local_free = 0;
+	page_adopt_thread_free_block_list(page);
+	if (local_free) {
+		block_t* last_block = page->local_free;
+		while (last_block->next)
+			last_block = last_block->next;
+		last_block->next = local_free;
+		page->local_free_count += local_free_count;
+	}
+}
+
+//! Hand a linked list of blocks in the page over to the owning thread with a single compare-and-swap
 static NOINLINE void
-page_put_thread_free_block(page_t* page, block_t* block) {
+page_put_thread_free_block_list(page_t* page, block_t* first_block, block_t* last_block, uint32_t block_count) {
 	atomic_thread_fence(memory_order_acquire);
 	if (page->is_full) {
-		// Page is full, put the block in the heap thread free list instead, otherwise
+		// Page is full, put the blocks in the heap thread free list instead, otherwise
 		// the heap will not pick up the free blocks until a thread local free happens
 		heap_t* heap = page->heap;
 		uintptr_t prev_head = atomic_load_explicit(&heap->thread_free[page->page_type], memory_order_relaxed);
-		block->next = (void*)prev_head;
-		while (!atomic_compare_exchange_weak_explicit(&heap->thread_free[page->page_type], &prev_head, (uintptr_t)block,
-		                                              memory_order_release, memory_order_relaxed)) {
-			block->next = (void*)prev_head;
+		last_block->next = (void*)prev_head;
+		while (!atomic_compare_exchange_weak_explicit(&heap->thread_free[page->page_type], &prev_head,
+		                                              (uintptr_t)first_block, memory_order_release,
+		                                              memory_order_relaxed)) {
+			last_block->next = (void*)prev_head;
 			wait_spin();
 		}
 	} else {
 		unsigned long long prev_thread_free = atomic_load_explicit(&page->thread_free, memory_order_relaxed);
-		uint32_t block_index = page_block_index(page, block);
-		rpmalloc_assert(page_block(page, block_index) == block, "Block pointer is not aligned to start of block");
-		uint32_t list_size = page_block_from_thread_free_list(page, prev_thread_free, &block->next) + 1;
+		uint32_t block_index = page_block_index(page, first_block);
+		rpmalloc_assert(page_block(page, block_index) == first_block, "Block pointer is not aligned to start of block");
+		uint32_t list_size = page_block_from_thread_free_list(page, prev_thread_free, &last_block->next) + block_count;
 		uint64_t thread_free = page_block_to_thread_free_list(page, block_index, list_size);
 		while (!atomic_compare_exchange_weak_explicit(&page->thread_free, &prev_thread_free, thread_free,
 		                                              memory_order_release, memory_order_relaxed)) {
-			list_size = page_block_from_thread_free_list(page, prev_thread_free, &block->next) + 1;
+			list_size = page_block_from_thread_free_list(page, prev_thread_free, &last_block->next) + block_count;
 			thread_free = page_block_to_thread_free_list(page, block_index, list_size);
 			wait_spin();
 		}
 	}
 }
 
+static inline void
+page_put_thread_free_block(page_t* page, block_t* block) {
+	page_put_thread_free_block_list(page, block, block, 1);
+}
+
+static void
+heap_remote_free_publish(remote_free_t* remote) {
+	page_put_thread_free_block_list(remote->page, remote->first, remote->last, remote->count);
+	remote->page = 0;
+	remote->count = 0;
+}
+
+//! Hand all buffered blocks freed to pages of other threads over to the owning threads
+static void
+heap_remote_free_flush(heap_t* heap) {
+	for (uint32_t islot = 0; islot < REMOTE_FREE_PAGE_COUNT; ++islot) {
+		if (heap->remote_free[islot].page)
+			heap_remote_free_publish(heap->remote_free + islot);
+	}
+}
+
+//! Buffer a block freed to a page owned by another thread. Blocks are handed over as a single list per
+//  page when the buffer fills, when the buffer is needed for another page or at the next collect
+static void
+heap_remote_free_block(heap_t* heap, page_t* page, block_t* block) {
+	remote_free_t* remote = 0;
+	remote_free_t* unused = 0;
+	for (uint32_t islot = 0; islot < REMOTE_FREE_PAGE_COUNT; ++islot) {
+		if (heap->remote_free[islot].page == page) {
+			remote = heap->remote_free + islot;
+			break;
+		}
+		if (!unused && !heap->remote_free[islot].page)
+			unused = heap->remote_free + islot;
+	}
+	if (!remote) {
+		remote = unused;
+		if (!remote) {
+			remote = heap->remote_free + heap->remote_free_next;
+			heap->remote_free_next = (heap->remote_free_next + 1) % REMOTE_FREE_PAGE_COUNT;
+			heap_remote_free_publish(remote);
+		}
+		remote->page = page;
+		remote->last = block;
+		remote->first = 0;
+	}
+	block->next = remote->first;
+	remote->first = block;
+	++remote->count;
+	if ((remote->count >= REMOTE_FREE_BLOCK_LIMIT) || ((remote->count * page->block_size) >= REMOTE_FREE_BYTE_LIMIT))
+		heap_remote_free_publish(remote);
+}
+
 static void
 page_push_local_free_to_heap(page_t* page) {
 	// Push the page free list as the fast track list of free blocks for heap
@@ -1215,19 +1622,214 @@ page_allocate_block(page_t* page, unsigned int zero) {
 
 ////////////
 ///
-/// Span interface
+/// Huge block cache
 ///
 //////
 
-static inline int
-span_is_thread_heap(span_t* span) {
-#if RPMALLOC_FIRST_CLASS_HEAPS
-	return (!span->heap->owner_thread || (span->heap->owner_thread == get_thread_id()));
-#else
-	return (span->heap->owner_thread == get_thread_id());
-#endif
+static inline void
+huge_cache_lock_acquire(void) {
+	uintptr_t lock = 0;
+	uintptr_t this_lock = get_thread_id();
+	while (!atomic_compare_exchange_strong(&global_huge_cache_lock, &lock, this_lock)) {
+		lock = 0;
+		wait_spin();
+	}
+}
+
+static inline void
+huge_cache_lock_release(void) {
+	rpmalloc_assert((uintptr_t)atomic_load_explicit(&global_huge_cache_lock, memory_order_relaxed) == get_thread_id(),
+	                "Bad huge cache lock");
+	atomic_store_explicit(&global_huge_cache_lock, 0, memory_order_release);
+}
+
+static inline size_t
+huge_span_size(span_t* span) {
+	return (size_t)span->page_size * (size_t)span->page_count;
 }
 
+//! Number of bytes the huge block cache may hold under the current memory pressure
+static inline size_t
+huge_cache_limit(void) {
+	return global_huge_cache_limit >> (2 * atomic_load_explicit(&global_memory_pressure, memory_order_relaxed));
+}
+
+static inline uint32_t
+huge_cache_bucket(size_t size) {
+	return (uint32_t)((sizeof(size_t) * 8 - 1) - rpmalloc_clz((uintptr_t)size));
+}
+
+static void
+huge_cache_unlink(span_t* span, uint32_t bucket) {
+	span_t* prev = (span_t*)span->page.prev;
+	span_t* next = (span_t*)span->page.next;
+	if (prev)
+		prev->page.next = (page_t*)next;
+	else
+		global_huge_cache[bucket] = next;
+	if (next)
+		next->page.prev = (page_t*)prev;
+	else
+		global_huge_cache_tail[bucket] = prev;
+	atomic_fetch_sub_explicit(&global_huge_cache_size, span->mapped_size, memory_order_relaxed);
+}
+
+//! Unlink spans older than the maximum age and then the oldest spans until the cache holds at most
+//  the given number of bytes, returns the unlinked spans linked through the span next pointer
+static span_t*
+huge_cache_evict_locked(uint32_t now, size_t size_limit) {
+	span_t* evicted = 0;
+	for (uint32_t ibucket = 0; ibucket < HUGE_CACHE_BUCKET_COUNT; ++ibucket) {
+		span_t* span = global_huge_cache_tail[ibucket];
+		while (span && ((uint32_t)(now - span->cache_tick) > HUGE_CACHE_MAX_AGE_MS)) {
+			span_t* prev = (span_t*)span->page.prev;
+			huge_cache_unlink(span, ibucket);
+			span->next = evicted;
+			evicted = span;
+			span = prev;
+		}
+	}
+	while (atomic_load_explicit(&global_huge_cache_size, memory_order_relaxed) > size_limit) {
+		uint32_t oldest_bucket = 0;
+		uint32_t oldest_age = 0;
+		span_t* oldest = 0;
+		for (uint32_t ibucket = 0; ibucket < HUGE_CACHE_BUCKET_COUNT; ++ibucket) {
+			span_t* span = global_huge_cache_tail[ibucket];
+			if (span && (!oldest || ((uint32_t)(now - span->cache_tick) >= oldest_age))) {
+				oldest = span;
+				oldest_age = (uint32_t)(now - span->cache_tick);
+				oldest_bucket = ibucket;
+			}
+		}
+		huge_cache_unlink(oldest, oldest_bucket);
+		oldest->next = evicted;
+		evicted = oldest;
+	}
+	return evicted;
+}
+
+static void
+huge_cache_unmap_list(span_t* span) {
+	while (span) {
+		span_t* next = span->next;
+		statistics_unmap(span->mapped_size);
+		global_memory_interface->memory_unmap(span, span->offset, span->mapped_size);
+		span = next;
+	}
+}
+
+//! Keep a freed huge span for reuse, returns 0 if the span should be unmapped instead. The cache holds
+//  the whole mapping including alignment padding and reallocation headroom, so it is accounted and
+//  evicted by mapped size while buckets are chosen by the usable size
+static int
+huge_cache_insert(span_t* span) {
+	size_t mapped_size = span->mapped_size;
+	size_t limit = huge_cache_limit();
+	if (mapped_size > limit)
+		return 0;
+	uint32_t now = os_tick_ms();
+	uint32_t bucket = huge_cache_bucket(huge_span_size(span));
+	huge_cache_lock_acquire();
+	span_t* evicted = huge_cache_evict_locked(now, limit - mapped_size);
+	span->cache_tick = now;
+	span->page.prev = 0;
+	span->page.next = (page_t*)global_huge_cache[bucket];
+	if (global_huge_cache[bucket])
+		global_huge_cache[bucket]->page.prev = (page_t*)span;
+	else
+		global_huge_cache_tail[bucket] = span;
+	global_huge_cache[bucket] = span;
+	atomic_fetch_add_explicit(&global_huge_cache_size, mapped_size, memory_order_relaxed);
+	huge_cache_lock_release();
+	huge_cache_unmap_list(evicted);
+	return 1;
+}
+
+//! Take a cached huge span of at least the given size, wasting at most half the size again
+static span_t*
+huge_cache_extract(size_t size) {
+	if (!atomic_load_explicit(&global_huge_cache_size, memory_order_relaxed))
+		return 0;
+	size_t max_size = size + (size >> 1);
+	uint32_t bucket = huge_cache_bucket(size);
+	span_t* found = 0;
+	huge_cache_lock_acquire();
+	for (uint32_t ibucket = bucket; !found && (ibucket <= bucket + 1) && (ibucket < HUGE_CACHE_BUCKET_COUNT);
+	     ++ibucket) {
+		for (span_t* span = global_huge_cache[ibucket]; span; span = (span_t*)span->page.next) {
+			size_t span_size = huge_span_size(span);
+			if ((span_size >= size) && (span_size <= max_size)) {
+				huge_cache_unlink(span, ibucket);
+				found = span;
+				break;
+			}
+		}
+	}
+	huge_cache_lock_release();
+	return found;
+}
+
+//! Track a huge span of a first class heap for rpmalloc_heap_free_all. Huge blocks can be freed by
+//  any thread through the generic interface, so the list is guarded by the huge block cache lock
+static void
+heap_huge_span_link(heap_t* heap, span_t* span) {
+	huge_cache_lock_acquire();
+	span->page.prev = 0;
+	span->page.next = (page_t*)heap->span_used[PAGE_HUGE];
+	if (heap->span_used[PAGE_HUGE])
+		heap->span_used[PAGE_HUGE]->page.prev = (page_t*)span;
+	heap->span_used[PAGE_HUGE] = span;
+	huge_cache_lock_release();
+}
+
+static void
+heap_huge_span_unlink(heap_t* heap, span_t* span) {
+	huge_cache_lock_acquire();
+	if (span->page.prev)
+		span->page.prev->next = span->page.next;
+	else
+		heap->span_used[PAGE_HUGE] = (span_t*)span->page.next;
+	if (span->page.next)
+		span->page.next->prev = span->page.prev;
+	huge_cache_lock_release();
+}
+
+//! Take the whole huge span list of a first class heap
+static span_t*
+heap_huge_span_detach(heap_t* heap) {
+	huge_cache_lock_acquire();
+	span_t* span = heap->span_used[PAGE_HUGE];
+	heap->span_used[PAGE_HUGE] = 0;
+	huge_cache_lock_release();
+	return span;
+}
+
+//! Unmap cached huge spans that exceeded the maximum age or the cache limit
+static void
+huge_cache_evict(void) {
+	if (!atomic_load_explicit(&global_huge_cache_size, memory_order_relaxed))
+		return;
+	huge_cache_lock_acquire();
+	span_t* evicted = huge_cache_evict_locked(os_tick_ms(), huge_cache_limit());
+	huge_cache_lock_release();
+	huge_cache_unmap_list(evicted);
+}
+
+static void
+huge_cache_finalize(int unmap) {
+	huge_cache_lock_acquire();
+	span_t* evicted = huge_cache_evict_locked(0, 0);
+	huge_cache_lock_release();
+	if (unmap)
+		huge_cache_unmap_list(evicted);
+}
+
+////////////
+///
+/// Span interface
+///
+//////
+
 static inline page_t*
 span_get_page_from_block(span_t* span, void* block) {
 	return (page_t*)((uintptr_t)block & span->page_address_mask);
@@ -1251,7 +1853,7 @@ span_allocate_page(span_t* span) {
 	page->page_type = span->page_type;
 	page->is_zero = 1;
 	page->heap = heap;
-	rpmalloc_assert(page_is_thread_heap(page), "Page owner thread mismatch");
+	rpmalloc_assert(!heap->owner_thread || page_is_thread_heap(page), "Page owner thread mismatch");
 
 	if (span->page_initialized == span->page_count) {
 		// Span fully utilized
@@ -1268,7 +1870,14 @@ span_allocate_page(span_t* span) {
 static NOINLINE void
 span_deallocate_block(span_t* span, page_t* page, void* block) {
 	if (UNEXPECTED(page->page_type == PAGE_HUGE)) {
-		global_memory_interface->memory_unmap(span, span->offset, span->mapped_size);
+		statistics_huge_free(huge_span_size(span));
+		// First class heaps track their huge spans in a list, never cache those
+		if (!span->heap->owner_thread)
+			heap_huge_span_unlink(span->heap, span);
+		if (!span->heap->owner_thread || !huge_cache_insert(span)) {
+			statistics_unmap(span->mapped_size);
+			global_memory_interface->memory_unmap(span, span->offset, span->mapped_size);
+		}
 		return;
 	}
 
@@ -1279,10 +1888,17 @@ span_deallocate_block(span_t* span, page_t* page, void* block) {
 
 	int is_thread_local = page_is_thread_heap(page);
 	if (EXPECTED(is_thread_local != 0)) {
+		heap_statistics_free(page->heap, page->size_class, 1);
 		page_put_local_free_block(page, block);
 	} else {
-		// Multithreaded deallocation, push to deferred deallocation list.
-		page_put_thread_free_block(page, block);
+		// Multithreaded deallocation, buffer in the freeing thread heap if it has one and hand over
+		// to the deferred deallocation list of the page in batches. Blocks of first class heaps are
+		// handed over at once, the heap can be cleared at any time with all its spans unmapped
+		heap_t* heap = get_thread_heap();
+		if (heap->owner_thread && page->heap->owner_thread)
+			heap_remote_free_block(heap, page, block);
+		else
+			page_put_thread_free_block(page, block);
 	}
 }
 
@@ -1294,12 +1910,12 @@ span_deallocate_block(span_t* span, page_t* page, void* block) {
 
 static inline span_t*
 block_get_span(block_t* block) {
-	return (span_t*)((uintptr_t)block & SPAN_MASK);
+	return (span_t*)((uintptr_t)block & global_span_mask);
 }
 
 static inline void
 block_deallocate(block_t* block) {
-	span_t* span = (span_t*)((uintptr_t)block & SPAN_MASK);
+	span_t* span = (span_t*)((uintptr_t)block & global_span_mask);
 	page_t* page = span_get_page_from_block(span, block);
 	const int is_thread_local = page_is_thread_heap(page);
 
@@ -1311,6 +1927,7 @@ block_deallocate(block_t* block) {
 			block->next = page->local_free;
 			page->local_free = block;
 			++page->local_free_count;
+			heap_statistics_free(page->heap, page->size_class, 1);
 			if (UNEXPECTED(--page->block_used == 0))
 				page_available_to_free(page);
 		} else {
@@ -1321,9 +1938,65 @@ block_deallocate(block_t* block) {
 	}
 }
 
+//! Number of pages with blocks owned by other threads grouped at a time in a batch free
+#define BLOCK_BATCH_PAGE_COUNT 16
+
+//! Free a batch of blocks, blocks owned by other threads are linked up per page and handed over
+//  with a single compare-and-swap for each page
+static void
+block_deallocate_batch(void** blocks, size_t count) {
+	page_t* group_page[BLOCK_BATCH_PAGE_COUNT];
+	block_t* group_first[BLOCK_BATCH_PAGE_COUNT];
+	block_t* group_last[BLOCK_BATCH_PAGE_COUNT];
+	uint32_t group_block_count[BLOCK_BATCH_PAGE_COUNT];
+	uint32_t group_count = 0;
+	uint32_t igroup = 0;
+	for (size_t iblock = 0; iblock < count; ++iblock) {
+		block_t* block = blocks[iblock];
+		if (!block)
+			continue;
+		span_t* span = block_get_span(block);
+		page_t* page = span_get_page_from_block(span, block);
+		if (page_is_thread_heap(page) || (page->page_type == PAGE_HUGE)) {
+			block_deallocate(block);
+			continue;
+		}
+		if (page->has_aligned_block)
+			block = page_block_realign(page, block);
+
+		// Consecutive frees usually hit the same page, check the last used group first
+		if ((igroup >= group_count) || (group_page[igroup] != page)) {
+			for (igroup = 0; igroup < group_count; ++igroup) {
+				if (group_page[igroup] == page)
+					break;
+			}
+			if (igroup == group_count) {
+				if (group_count == BLOCK_BATCH_PAGE_COUNT) {
+					for (uint32_t iflush = 0; iflush < group_count; ++iflush)
+						page_put_thread_free_block_list(group_page[iflush], group_first[iflush], group_last[iflush],
+						                                group_block_count[iflush]);
+					group_count = 0;
+					igroup = 0;
+				}
+				group_page[igroup] = page;
+				group_first[igroup] = 0;
+				group_last[igroup] = block;
+				group_block_count[igroup] = 0;
+				++group_count;
+			}
+		}
+		block->next = group_first[igroup];
+		group_first[igroup] = block;
+		++group_block_count[igroup];
+	}
+	for (igroup = 0; igroup < group_count; ++igroup)
+		page_put_thread_free_block_list(group_page[igroup], group_first[igroup], group_last[igroup],
+		                                group_block_count[igroup]);
+}
+
 static inline size_t
 block_usable_size(block_t* block) {
-	span_t* span = (span_t*)((uintptr_t)block & SPAN_MASK);
+	span_t* span = (span_t*)((uintptr_t)block & global_span_mask);
 	if (EXPECTED(span->page_type <= PAGE_LARGE)) {
 		page_t* page = span_get_page_from_block(span, block);
 		void* blocks_start = pointer_offset(page, PAGE_HEADER_SIZE);
@@ -1333,27 +2006,166 @@ block_usable_size(block_t* block) {
 	}
 }
 
+////////////
+///
+/// Global cache
+///
+//////
+
+//! Slot marker for an item temporarily taken out of a global cache by the scavenger
+#define GLOBAL_CACHE_SLOT_BUSY ((uintptr_t)1)
+
+//! Store an item in a free slot of a global cache, returns 0 if the cache is full. Slots are claimed and
+//  released with a single compare-and-swap, so no lock is needed and a popped item is owned exclusively.
+static int
+global_cache_push(atomic_uintptr_t* slots, atomic_int* count, uint32_t slot_count, int limit, void* item) {
+	if (atomic_load_explicit(count, memory_order_relaxed) >= limit)
+		return 0;
+	for (uint32_t islot = 0; islot < slot_count; ++islot) {
+		uintptr_t expected = 0;
+		if (atomic_load_explicit(slots + islot, memory_order_relaxed) != 0)
+			continue;
+		if (atomic_compare_exchange_strong_explicit(slots + islot, &expected, (uintptr_t)item, memory_order_release,
+		                                            memory_order_relaxed)) {
+			atomic_fetch_add_explicit(count, 1, memory_order_relaxed);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//! Take any item from a global cache, returns null if the cache is empty
+static void*
+global_cache_pop(atomic_uintptr_t* slots, atomic_int* count, uint32_t slot_count) {
+	if (atomic_load_explicit(count, memory_order_relaxed) <= 0)
+		return 0;
+	for (uint32_t islot = 0; islot < slot_count; ++islot) {
+		uintptr_t item = atomic_load_explicit(slots + islot, memory_order_relaxed);
+		if ((item > GLOBAL_CACHE_SLOT_BUSY) &&
+		    atomic_compare_exchange_strong_explicit(slots + islot, &item, 0, memory_order_acquire,
+		                                            memory_order_relaxed)) {
+			atomic_fetch_sub_explicit(count, 1, memory_order_relaxed);
+			return (void*)item;
+		}
+	}
+	return 0;
+}
+
+static inline page_t*
+global_cache_pop_page(page_type_t page_type) {
+	return global_cache_pop(global_page_cache[page_type], &global_page_cache_count[page_type],
+	                        GLOBAL_PAGE_CACHE_SLOTS);
+}
+
+static inline span_t*
+global_cache_pop_span(page_type_t page_type) {
+	return global_cache_pop(global_span_cache[page_type], &global_span_cache_count[page_type],
+	                        GLOBAL_SPAN_CACHE_SLOTS);
+}
+
+//! Decommit committed pages that have stayed in the global page cache for at least the given number of
+//  milliseconds, until the byte limit is reached. Pages are marked busy in their slot while decommitting
+//  so they can neither be taken by a heap nor have their slot reused. Returns the number of bytes decommitted.
+static size_t
+global_cache_scavenge(size_t byte_limit, uint32_t min_age_ms) {
+	size_t decommitted = 0;
+	uint32_t now = os_tick_ms();
+	for (int itype = 0; (itype < 3) && (decommitted < byte_limit); ++itype) {
+		atomic_uintptr_t* slots = global_page_cache[itype];
+		if (atomic_load_explicit(&global_page_cache_count[itype], memory_order_relaxed) <= 0)
+			continue;
+		size_t page_bytes = global_page_size[itype] - global_config.page_size;
+		for (uint32_t islot = 0; (islot < GLOBAL_PAGE_CACHE_SLOTS) && (decommitted < byte_limit); ++islot) {
+			uintptr_t item = atomic_load_explicit(slots + islot, memory_order_relaxed);
+			if ((item <= GLOBAL_CACHE_SLOT_BUSY) ||
+			    !atomic_compare_exchange_strong_explicit(slots + islot, &item, GLOBAL_CACHE_SLOT_BUSY,
+			                                             memory_order_acquire, memory_order_relaxed))
+				continue;
+			page_t* page = (page_t*)item;
+			if (!page->is_decommitted && ((uint32_t)(now - page->free_tick) >= min_age_ms)) {
+				page_decommit_memory_pages(page);
+				decommitted += page_bytes;
+			}
+			atomic_store_explicit(slots + islot, item, memory_order_release);
+		}
+	}
+	return decommitted;
+}
+
+//! Drop all cached pages and unmap cached spans, pages are unmapped with the span owning them
+static void
+global_cache_finalize(int unmap) {
+	for (int itype = 0; itype < 3; ++itype) {
+		while (global_cache_pop_page((page_type_t)itype))
+			;
+		span_t* span;
+		while ((span = global_cache_pop_span((page_type_t)itype)) != 0) {
+			if (unmap) {
+				statistics_unmap(span->mapped_size);
+				global_memory_interface->memory_unmap(span, span->offset, span->mapped_size);
+			}
+		}
+	}
+}
+
 ////////////
 ///
 /// Heap interface
 ///
 //////
 
-static inline void
-heap_lock_acquire(void) {
-	uintptr_t lock = 0;
-	uintptr_t this_lock = get_thread_id();
-	while (!atomic_compare_exchange_strong(&global_heap_lock, &lock, this_lock)) {
-		lock = 0;
-		wait_spin();
+// Heaps are mapped at least page aligned and are never unmapped before finalization, the free heap stack
+// head stores the heap address shifted down by the page alignment in the low bits and a tag incremented on
+// every update in the high bits, so a stale head can never be swapped in (ABA)
+#define HEAP_QUEUE_ADDRESS_SHIFT 12
+#define HEAP_QUEUE_ADDRESS_BITS 40
+#define HEAP_QUEUE_ADDRESS_MASK ((1ULL << HEAP_QUEUE_ADDRESS_BITS) - 1)
+
+static inline heap_t*
+heap_queue_get_heap(unsigned long long head) {
+	return (heap_t*)(uintptr_t)((head & HEAP_QUEUE_ADDRESS_MASK) << HEAP_QUEUE_ADDRESS_SHIFT);
+}
+
+static inline unsigned long long
+heap_queue_make_head(heap_t* heap, unsigned long long prev_head) {
+	unsigned long long tag = (prev_head >> HEAP_QUEUE_ADDRESS_BITS) + 1;
+	return ((unsigned long long)((uintptr_t)heap >> HEAP_QUEUE_ADDRESS_SHIFT)) | (tag << HEAP_QUEUE_ADDRESS_BITS);
+}
+
+//! Pop a heap from the free heap stack
+static heap_t*
+heap_queue_pop(void) {
+	unsigned long long head = atomic_load_explicit(&global_heap_queue, memory_order_acquire);
+	heap_t* heap = heap_queue_get_heap(head);
+	while (heap) {
+		unsigned long long next_head = heap_queue_make_head(heap->next, head);
+		if (atomic_compare_exchange_weak_explicit(&global_heap_queue, &head, next_head, memory_order_acquire,
+		                                          memory_order_acquire))
+			break;
+		heap = heap_queue_get_heap(head);
 	}
+	return heap;
 }
 
-static inline void
-heap_lock_release(void) {
-	rpmalloc_assert((uintptr_t)atomic_load_explicit(&global_heap_lock, memory_order_relaxed) == get_thread_id(),
-	                "Bad heap lock");
-	atomic_store_explicit(&global_heap_lock, 0, memory_order_release);
+//! Push a heap to the free heap stack
+static void
+heap_queue_push(heap_t* heap) {
+	rpmalloc_assert(!((uintptr_t)heap & ((1 << HEAP_QUEUE_ADDRESS_SHIFT) - 1)), "Heap not page aligned");
+	unsigned long long head = atomic_load_explicit(&global_heap_queue, memory_order_relaxed);
+	do {
+		heap->next = heap_queue_get_heap(head);
+	} while (!atomic_compare_exchange_weak_explicit(&global_heap_queue, &head, heap_queue_make_head(heap, head),
+	                                                memory_order_release, memory_order_relaxed));
+}
+
+//! Add a new heap to the list of all heaps
+static void
+heap_list_insert(heap_t* heap) {
+	uintptr_t head = atomic_load_explicit(&global_heap_list, memory_order_relaxed);
+	do {
+		heap->next_heap = (heap_t*)head;
+	} while (!atomic_compare_exchange_weak_explicit(&global_heap_list, &head, (uintptr_t)heap, memory_order_release,
+	                                                memory_order_relaxed));
 }
 
 static inline heap_t*
@@ -1378,6 +2190,8 @@ heap_allocate_new(void) {
 	heap_t* heap = heap_initialize((void*)block);
 	heap->offset = (uint32_t)offset;
 	heap->mapped_size = mapped_size;
+	heap_list_insert(heap);
+	statistics_map(mapped_size);
 #if ENABLE_STATISTICS
 	atomic_fetch_add_explicit(&global_statistics.heap_count, 1, memory_order_relaxed);
 #endif
@@ -1386,60 +2200,133 @@ heap_allocate_new(void) {
 
 static void
 heap_unmap(heap_t* heap) {
+	statistics_unmap(heap->mapped_size);
 	global_memory_interface->memory_unmap(heap, heap->offset, heap->mapped_size);
 }
 
 static heap_t*
 heap_allocate(int first_class) {
-	heap_t* heap = 0;
-	if (!first_class) {
-		heap_lock_acquire();
-		heap = global_heap_queue;
-		global_heap_queue = heap ? heap->next : 0;
-		heap_lock_release();
-	}
+	heap_t* heap = (!first_class) ? heap_queue_pop() : 0;
 	if (!heap)
 		heap = heap_allocate_new();
 	if (heap) {
-		uintptr_t current_thread_id = get_thread_id();
-		heap_lock_acquire();
-		heap->next = global_heap_used;
-		heap->prev = 0;
-		if (global_heap_used)
-			global_heap_used->prev = heap;
-		global_heap_used = heap;
-		heap_lock_release();
-		heap->owner_thread = current_thread_id;
+		heap->next = 0;
+		heap->owner_thread = get_thread_id();
 	}
 	return heap;
 }
 
+static void
+heap_collect(heap_t* heap);
+
+//! Hand the free pages of the given type following the link over to the global page cache, until the cache
+//  holds the given number of pages. Must be called with the free page lock held.
+static void
+heap_page_free_spill(heap_t* heap, uint32_t page_type, page_t** link, int cache_limit) {
+	uint32_t now = os_tick_ms();
+	page_t* page = *link;
+	while (page) {
+		// Once pushed the page can be taken by another thread at any time
+		page_t* next_page = page->next;
+		uint32_t is_decommitted = page->is_decommitted;
+		page->free_tick = now;
+		if (!global_cache_push(global_page_cache[page_type], &global_page_cache_count[page_type],
+		                       GLOBAL_PAGE_CACHE_SLOTS, cache_limit, page))
+			break;
+		if (!is_decommitted)
+			--heap->page_free_commit_count[page_type];
+#if ENABLE_STATISTICS
+		heap->statistics.thread_to_global += global_page_size[page_type];
+#endif
+		page = next_page;
+	}
+	*link = page;
+}
+
+//! Hand the free pages and partially initialized spans of a heap over to the global cache
+static void
+heap_release_to_global_cache(heap_t* heap) {
+	for (int itype = 0; itype < 3; ++itype) {
+		heap_page_free_lock(heap);
+		heap_page_free_spill(heap, (uint32_t)itype, &heap->page_free[itype], global_page_cache_limit[itype]);
+		heap_page_free_unlock(heap);
+
+		span_t* span = heap->span_partial[itype];
+		if (span) {
+			span->next = 0;
+			if (global_cache_push(global_span_cache[itype], &global_span_cache_count[itype], GLOBAL_SPAN_CACHE_SLOTS,
+			                      GLOBAL_SPAN_CACHE_SLOTS, span)) {
+				heap->span_partial[itype] = 0;
+#if ENABLE_STATISTICS
+				++heap->statistics.span_use[itype].to_global;
+				--heap->statistics.span_use[itype].current;
+#endif
+			}
+		}
+	}
+}
+
 static inline void
 heap_release(heap_t* heap) {
-	heap_lock_acquire();
-	if (heap->prev)
-		heap->prev->next = heap->next;
-	if (heap->next)
-		heap->next->prev = heap->prev;
-	if (global_heap_used == heap)
-		global_heap_used = heap->next;
-	heap->next = global_heap_queue;
-	global_heap_queue = heap;
-	heap_lock_release();
+	// First class heaps can be cleared with all their spans, they never share memory through the global cache
+	if (heap->owner_thread) {
+		heap_collect(heap);
+		heap_release_to_global_cache(heap);
+	}
+	heap_queue_push(heap);
 }
 
+//! Decommit or spill the free pages of the given type past the retain count, must be called with the free page
+//  lock held. Committed pages are listed first, pages are pushed to the front as they are freed.
 static void
 heap_page_free_decommit(heap_t* heap, uint32_t page_type, uint32_t page_retain_count) {
-	page_t* page = heap->page_free[page_type];
-	while (page && page_retain_count) {
-		page = page->next;
+	page_t** link = &heap->page_free[page_type];
+	while (*link && page_retain_count) {
+		link = &(*link)->next;
 		--page_retain_count;
 	}
-	while (page && (page->is_decommitted == 0)) {
-		page_decommit_memory_pages(page);
-		--heap->page_free_commit_count[page_type];
-		page = page->next;
+	// First class heaps never share pages and decommit inline
+	if (!heap->owner_thread) {
+		for (page_t* page = *link; page && (page->is_decommitted == 0); page = page->next) {
+			page_decommit_memory_pages(page);
+			--heap->page_free_commit_count[page_type];
+		}
+		return;
 	}
+	if (global_config.enable_scavenger) {
+		// Leave decommit to the scavenger, hand the excess committed pages to the global page cache
+		// where it will find them. Pages that do not fit stay with the heap until the next attempt.
+		heap_page_free_spill(heap, page_type, link, global_page_cache_limit[page_type]);
+		if (*link && !(*link)->is_decommitted)
+			return;
+	} else {
+		for (page_t* page = *link; page && (page->is_decommitted == 0); page = page->next) {
+			page_decommit_memory_pages(page);
+			--heap->page_free_commit_count[page_type];
+		}
+	}
+	// Excess decommitted pages only hold address space, hand them to other threads through the global
+	// page cache but leave half of it for committed pages
+	heap_page_free_spill(heap, page_type, link, global_page_cache_limit[page_type] / 2);
+}
+
+//! Hand all free pages of an idle heap to the global page cache, decommitted unless the scavenger will do it.
+//  Pages not fitting in the cache stay with the heap, decommitted. Must be called with the free page lock held.
+//  Returns the number of committed bytes leaving the heap.
+static size_t
+heap_page_free_trim(heap_t* heap) {
+	size_t trimmed = 0;
+	for (uint32_t itype = 0; itype < 3; ++itype) {
+		trimmed += (size_t)heap->page_free_commit_count[itype] * (global_page_size[itype] - global_config.page_size);
+		if (!global_config.enable_scavenger)
+			heap_page_free_decommit(heap, itype, 0);
+		heap_page_free_spill(heap, itype, &heap->page_free[itype], global_page_cache_limit[itype]);
+		for (page_t* page = heap->page_free[itype]; page && (page->is_decommitted == 0); page = page->next) {
+			page_decommit_memory_pages(page);
+			--heap->page_free_commit_count[itype];
+		}
+	}
+	return trimmed;
 }
 
 static inline void
@@ -1474,27 +2361,27 @@ heap_get_span(heap_t* heap, page_type_t page_type) {
 	if (EXPECTED(heap->span_partial[page_type] != 0))
 		return heap->span_partial[page_type];
 
+	// Adopt a partially initialized span released by an exited thread
+	span_t* span = heap->owner_thread ? global_cache_pop_span(page_type) : 0;
+	if (span) {
+		span->heap = heap;
+		heap->span_partial[page_type] = span;
+#if ENABLE_STATISTICS
+		++heap->statistics.span_use[page_type].from_global;
+		if (++heap->statistics.span_use[page_type].current > heap->statistics.span_use[page_type].peak)
+			heap->statistics.span_use[page_type].peak = heap->statistics.span_use[page_type].current;
+#endif
+		return span;
+	}
+
 	// Fallback path, map more memory
 	size_t offset = 0;
 	size_t mapped_size = 0;
-	span_t* span = global_memory_interface->memory_map(SPAN_SIZE, SPAN_SIZE, &offset, &mapped_size);
+	span = global_memory_interface->memory_map(global_span_size, global_span_size, &offset, &mapped_size);
 	if (EXPECTED(span != 0)) {
-		uint32_t page_count = 0;
-		uint32_t page_size = 0;
-		uintptr_t page_address_mask = 0;
-		if (page_type == PAGE_SMALL) {
-			page_count = SPAN_SIZE / SMALL_PAGE_SIZE;
-			page_size = SMALL_PAGE_SIZE;
-			page_address_mask = SMALL_PAGE_MASK;
-		} else if (page_type == PAGE_MEDIUM) {
-			page_count = SPAN_SIZE / MEDIUM_PAGE_SIZE;
-			page_size = MEDIUM_PAGE_SIZE;
-			page_address_mask = MEDIUM_PAGE_MASK;
-		} else {
-			page_count = SPAN_SIZE / LARGE_PAGE_SIZE;
-			page_size = LARGE_PAGE_SIZE;
-			page_address_mask = LARGE_PAGE_MASK;
-		}
+		uint32_t page_size = (uint32_t)global_page_size[page_type];
+		uint32_t page_count = (uint32_t)(global_span_size / page_size);
+		uintptr_t page_address_mask = global_page_mask[page_type];
 #if ENABLE_DECOMMIT
 		global_memory_interface->memory_commit(span, page_size);
 #endif
@@ -1507,6 +2394,8 @@ heap_get_span(heap_t* heap, page_type_t page_type) {
 		span->mapped_size = mapped_size;
 
 		heap->span_partial[page_type] = span;
+		statistics_map(mapped_size);
+		heap_statistics_span_map(heap, page_type);
 	}
 
 	return span;
@@ -1518,28 +2407,45 @@ heap_get_page(heap_t* heap, uint32_t size_class);
 static void
 block_deallocate(block_t* block);
 
+//! Deallocate the blocks other threads freed into full pages of the given type, returns 0 if there were none.
+//  The caller owns the heap, so blocks of its own pages go straight to the page local free list. This must
+//  not go through block_deallocate, which hands blocks of first class heaps (no owner thread) back to this list
+static int
+heap_free_thread_free_blocks(heap_t* heap, page_type_t page_type) {
+	uintptr_t block_mt = atomic_load_explicit(&heap->thread_free[page_type], memory_order_acquire);
+	if (EXPECTED(block_mt == 0))
+		return 0;
+	while (!atomic_compare_exchange_weak_explicit(&heap->thread_free[page_type], &block_mt, 0, memory_order_acquire,
+	                                              memory_order_relaxed)) {
+		wait_spin();
+	}
+	block_t* block = (void*)block_mt;
+	while (block) {
+		block_t* next_block = block->next;
+		page_t* page = span_get_page_from_block(block_get_span(block), block);
+		if (EXPECTED(page->heap == heap)) {
+			heap_statistics_free(heap, page->size_class, 1);
+			page_put_local_free_block(page, block);
+		} else {
+			block_deallocate(block);
+		}
+		block = next_block;
+	}
+	return 1;
+}
+
 static page_t*
 heap_get_page_generic(heap_t* heap, uint32_t size_class) {
 	page_type_t page_type = get_page_type(size_class);
 
 	// Check if there is a free page from multithreaded deallocations
-	uintptr_t block_mt = atomic_load_explicit(&heap->thread_free[page_type], memory_order_acquire);
-	if (UNEXPECTED(block_mt != 0)) {
-		while (!atomic_compare_exchange_weak_explicit(&heap->thread_free[page_type], &block_mt, 0, memory_order_release,
-		                                              memory_order_relaxed)) {
-			wait_spin();
-		}
-		block_t* block = (void*)block_mt;
-		while (block) {
-			block_t* next_block = block->next;
-			block_deallocate(block);
-			block = next_block;
-		}
+	if (UNEXPECTED(heap_free_thread_free_blocks(heap, page_type))) {
 		// Retry after processing deferred thread frees
 		return heap_get_page(heap, size_class);
 	}
 
 	// Check if there is a free page
+	heap_page_free_lock(heap);
 	page_t* page = heap->page_free[page_type];
 	if (EXPECTED(page != 0)) {
 		heap->page_free[page_type] = page->next;
@@ -1547,10 +2453,14 @@ heap_get_page_generic(heap_t* heap, uint32_t size_class) {
 			rpmalloc_assert(heap->page_free_commit_count[page_type] > 0, "Free committed page count out of sync");
 			--heap->page_free_commit_count[page_type];
 		}
+		heap_page_free_unlock(heap);
 		heap_make_free_page_available(heap, size_class, page);
+		heap_statistics_inc(heap, size_class, page_from_free);
 		return page;
 	}
 	rpmalloc_assert(heap->page_free_commit_count[page_type] == 0, "Free committed page count out of sync");
+	heap_page_free_unlock(heap);
+	atomic_store_explicit(&heap->active_tick, os_tick_ms(), memory_order_relaxed);
 
 	if (heap->id == 0) {
 		// Thread has not yet initialized, assign heap and try again
@@ -1558,14 +2468,30 @@ heap_get_page_generic(heap_t* heap, uint32_t size_class) {
 		return heap_get_page(get_thread_heap(), size_class);
 	}
 
+	// Check if there is a free page released by an exited thread
+	page = heap->owner_thread ? global_cache_pop_page(page_type) : 0;
+	if (page) {
+		heap_make_free_page_available(heap, size_class, page);
+#if ENABLE_STATISTICS
+		heap->statistics.global_to_thread += global_page_size[page_type];
+#endif
+		heap_statistics_inc(heap, size_class, page_from_free);
+		return page;
+	}
+
 	// Fallback path, find or allocate span for given size class
 	// If thread was not initialized, the heap for the new span
 	// will be different from the local heap variable in this scope
 	// (which is the default heap) - so use span page heap instead
+#if ENABLE_STATISTICS
+	if (!heap->span_partial[page_type])
+		heap_statistics_inc(heap, size_class, map_calls);
+#endif
 	span_t* span = heap_get_span(heap, page_type);
 	if (EXPECTED(span != 0)) {
 		page = span_allocate_page(span);
 		heap_make_free_page_available(page->heap, size_class, page);
+		heap_statistics_inc(page->heap, size_class, page_from_span);
 	}
 
 	return page;
@@ -1595,67 +2521,128 @@ heap_pop_local_free(heap_t* heap, uint32_t size_class) {
 static NOINLINE RPMALLOC_ALLOCATOR void*
 heap_allocate_block_small_to_large(heap_t* heap, uint32_t size_class, unsigned int zero) {
 	page_t* page = heap_get_page(heap, size_class);
-	if (EXPECTED(page != 0))
+	if (EXPECTED(page != 0)) {
+		heap_statistics_alloc(page->heap, size_class);
 		return page_allocate_block(page, zero);
+	}
 	return 0;
 }
 
-//! Generic allocation path from heap pages, spans or new mapping
+//! Allocate a huge block, optionally reserving extra virtual address space past the block which
+//  can later be committed to grow the block in place
 static NOINLINE RPMALLOC_ALLOCATOR void*
-heap_allocate_block_huge(heap_t* heap, size_t size, unsigned int zero) {
+heap_allocate_block_huge(heap_t* heap, size_t size, size_t reserve, unsigned int zero) {
 	if (heap->id == 0) {
 		rpmalloc_initialize(0);
 		heap = get_thread_heap();
 	}
 	size_t alloc_size = get_page_aligned_size(size + SPAN_HEADER_SIZE);
-	size_t offset = 0;
-	size_t mapped_size = 0;
-	void* block = global_memory_interface->memory_map(alloc_size, SPAN_SIZE, &offset, &mapped_size);
-	if (block) {
-		span_t* span = block;
+	// Reuse a recently freed huge span of similar size, still mapped and committed
+	span_t* span = heap->owner_thread ? huge_cache_extract(alloc_size) : 0;
+	if (span) {
+		alloc_size = huge_span_size(span);
+	} else {
+		size_t offset = 0;
+		size_t mapped_size = 0;
+		span = global_memory_interface->memory_map(alloc_size + reserve, global_span_size, &offset, &mapped_size);
+		if (!span)
+			return 0;
 #if ENABLE_DECOMMIT
 		global_memory_interface->memory_commit(span, alloc_size);
+#else
+		// Map functions commit up front without decommit support, release the headroom until it is grown into
+		if (mapped_size - offset > alloc_size)
+			global_memory_interface->memory_decommit(pointer_offset(span, alloc_size), mapped_size - offset - alloc_size);
 #endif
-		span->heap = heap;
-		span->page_type = PAGE_HUGE;
 		span->page_size = (uint32_t)global_config.page_size;
 		span->page_count = (uint32_t)(alloc_size / global_config.page_size);
-		span->page_address_mask = LARGE_PAGE_MASK;
 		span->offset = (uint32_t)offset;
 		span->mapped_size = mapped_size;
-		span->page.heap = heap;
-		span->page.is_full = 1;
-		span->page.generic_free = 1;
-		span->page.page_type = PAGE_HUGE;
-		// Keep track of span if first class heap
-		if (!heap->owner_thread) {
-			span->next = heap->span_used[PAGE_HUGE];
-			heap->span_used[PAGE_HUGE] = span;
-		}
-		void* ptr = pointer_offset(block, SPAN_HEADER_SIZE);
+		statistics_map(mapped_size);
+#if ENABLE_STATISTICS
+		// Huge blocks can be freed by any thread, current use is tracked in global statistics
+		++heap->statistics.span_use[PAGE_HUGE].map_calls;
+#endif
+	}
+	span->heap = heap;
+	span->page_type = PAGE_HUGE;
+	span->page_address_mask = global_page_mask[PAGE_LARGE];
+	span->page.heap = heap;
+	span->page.is_full = 1;
+	span->page.generic_free = 1;
+	span->page.page_type = PAGE_HUGE;
+	// Keep track of span if first class heap
+	if (!heap->owner_thread)
+		heap_huge_span_link(heap, span);
+	statistics_huge_alloc(alloc_size);
+	void* ptr = pointer_offset(span, SPAN_HEADER_SIZE);
+	if (zero)
+		memset(ptr, 0, size);
+	return ptr;
+}
+
+//! Allocate a block of the given size class served by small, medium or large pages
+static inline RPMALLOC_ALLOCATOR void*
+heap_allocate_block_class(heap_t* heap, uint32_t size_class, unsigned int zero) {
+	block_t* block = heap_pop_local_free(heap, size_class);
+	if (EXPECTED(block != 0)) {
+		// Fast track with small block available in heap level local free list
+		heap_statistics_alloc(heap, size_class);
 		if (zero)
-			memset(ptr, 0, size);
-		return ptr;
+			memset(block, 0, global_size_class[size_class].block_size);
+		return block;
 	}
-	return 0;
+
+	return heap_allocate_block_small_to_large(heap, size_class, zero);
 }
 
 static RPMALLOC_ALLOCATOR NOINLINE void*
 heap_allocate_block_generic(heap_t* heap, size_t size, unsigned int zero) {
 	uint32_t size_class = get_size_class(size);
-	if (EXPECTED(size_class < SIZE_CLASS_COUNT)) {
-		block_t* block = heap_pop_local_free(heap, size_class);
-		if (EXPECTED(block != 0)) {
-			// Fast track with small block available in heap level local free list
-			if (zero)
-				memset(block, 0, global_size_class[size_class].block_size);
-			return block;
-		}
+	if (EXPECTED(size_class < global_size_class_limit[PAGE_LARGE]))
+		return heap_allocate_block_class(heap, size_class, zero);
 
-		return heap_allocate_block_small_to_large(heap, size_class, zero);
-	}
+	return heap_allocate_block_huge(heap, size, 0, zero);
+}
 
-	return heap_allocate_block_huge(heap, size, zero);
+//! Allocate up to the given number of blocks of the same size, taking the heap local free list
+//  a whole list at a time. Returns the number of blocks allocated.
+static size_t
+heap_allocate_block_batch(heap_t* heap, size_t size, size_t count, void** blocks) {
+	size_t allocated = 0;
+	uint32_t size_class = get_size_class(size);
+	if (UNEXPECTED(size_class >= global_size_class_limit[PAGE_LARGE])) {
+		while (allocated < count) {
+			void* block = heap_allocate_block_huge(heap, size, 0, 0);
+			if (!block)
+				break;
+			blocks[allocated++] = block;
+		}
+		return allocated;
+	}
+	if (UNEXPECTED(heap->id == 0)) {
+		rpmalloc_initialize(0);
+		heap = get_thread_heap();
+	}
+	while (allocated < count) {
+		block_t* block = heap->local_free[size_class];
+		if (!block) {
+			// Allocating from the page pushes the rest of its local free list to the heap
+			page_t* page = heap_get_page(heap, size_class);
+			if (UNEXPECTED(page == 0))
+				break;
+			heap_statistics_alloc(heap, size_class);
+			blocks[allocated++] = page_allocate_block(page, 0);
+			continue;
+		}
+		while (block && (allocated < count)) {
+			heap_statistics_alloc(heap, size_class);
+			blocks[allocated++] = block;
+			block = block->next;
+		}
+		heap->local_free[size_class] = block;
+	}
+	return allocated;
 }
 
 //! Find or allocate a block of the given size
@@ -1666,6 +2653,7 @@ heap_allocate_block(heap_t* heap, size_t size, unsigned int zero) {
 		block_t* block = heap_pop_local_free(heap, size_class);
 		if (EXPECTED(block != 0)) {
 			// Fast track with small block available in heap level local free list
+			heap_statistics_alloc(heap, size_class);
 			if (zero)
 				memset(block, 0, global_size_class[size_class].block_size);
 			return block;
@@ -1676,7 +2664,7 @@ heap_allocate_block(heap_t* heap, size_t size, unsigned int zero) {
 
 static RPMALLOC_ALLOCATOR void*
 heap_allocate_block_aligned(heap_t* heap, size_t alignment, size_t size, unsigned int zero) {
-	if (alignment <= SMALL_GRANULARITY)
+	if (alignment <= BLOCK_MIN_ALIGNMENT)
 		return heap_allocate_block(heap, size, zero);
 
 #if ENABLE_VALIDATE_ARGS
@@ -1694,6 +2682,19 @@ heap_allocate_block_aligned(heap_t* heap, size_t alignment, size_t size, unsigne
 		return 0;
 	}
 
+	if (alignment <= PAGE_HEADER_SIZE) {
+		// Blocks start at the page header size offset from the page aligned page start, so all blocks of a class
+		// with a block size that is a multiple of the alignment are naturally aligned. Such blocks keep the fast
+		// free path, use the first of these classes unless it is larger than the over-allocation below
+		uint32_t size_class = get_size_class(size);
+		while ((size_class < global_size_class_limit[PAGE_LARGE]) &&
+		       (global_size_class[size_class].block_size <= (size + alignment))) {
+			if (!(global_size_class[size_class].block_size & (alignment - 1)))
+				return heap_allocate_block_class(heap, size_class, zero);
+			++size_class;
+		}
+	}
+
 	size_t align_mask = alignment - 1;
 	block_t* block = heap_allocate_block(heap, size + alignment, zero);
 	if ((uintptr_t)block & align_mask) {
@@ -1730,15 +2731,28 @@ heap_reallocate_block(heap_t* heap, void* block, size_t size, size_t old_size, u
 		} else {
 			// Huge block
 			void* block_start = pointer_offset(span, SPAN_HEADER_SIZE);
+			size_t span_size = huge_span_size(span);
 			if (!old_size)
-				old_size = ((size_t)span->page_size * (size_t)span->page_count) - SPAN_HEADER_SIZE;
-			if ((size < old_size) && (size > LARGE_BLOCK_SIZE_LIMIT)) {
+				old_size = span_size - SPAN_HEADER_SIZE;
+			if ((size < old_size) && (size > global_block_size_limit[PAGE_LARGE])) {
 				// Still fits in block and still huge, never mind trying to save memory,
 				// but preserve data if alignment changed
 				if ((block_start != block) && !(flags & RPMALLOC_NO_PRESERVE))
 					memmove(block_start, block, old_size);
 				return block_start;
 			}
+			size_t grow_size = get_page_aligned_size(size + SPAN_HEADER_SIZE);
+			if ((size >= old_size) && (grow_size <= (size_t)span->mapped_size - span->offset)) {
+				// Grow in place into the address space reserved past the block
+				if (grow_size > span_size) {
+					global_memory_interface->memory_commit(pointer_offset(span, span_size), grow_size - span_size);
+					span->page_count = (uint32_t)(grow_size / span->page_size);
+					statistics_huge_alloc(grow_size - span_size);
+				}
+				if ((block_start != block) && !(flags & RPMALLOC_NO_PRESERVE))
+					memmove(block_start, block, old_size);
+				return block_start;
+			}
 		}
 	} else {
 		old_size = 0;
@@ -1752,7 +2766,15 @@ heap_reallocate_block(heap_t* heap, void* block, size_t size, size_t old_size, u
 	size_t lower_bound = old_size + (old_size >> 2) + (old_size >> 3);
 	size_t new_size = (size > lower_bound) ? size : ((size > old_size) ? lower_bound : size);
 	void* old_block = block;
-	block = heap_allocate_block(heap, new_size, 0);
+	if (old_block && (new_size > old_size) && (new_size > global_block_size_limit[PAGE_LARGE])) {
+		// Growing into a huge block, reserve geometric headroom to allow future growth in place
+		size_t reserve = global_huge_reserve_uncommitted ? get_page_aligned_size(new_size) : 0;
+		if (reserve > HUGE_REALLOC_RESERVE_LIMIT)
+			reserve = HUGE_REALLOC_RESERVE_LIMIT;
+		block = heap_allocate_block_huge(heap, new_size, reserve, 0);
+	} else {
+		block = heap_allocate_block(heap, new_size, 0);
+	}
 	if (block && old_block) {
 		if (!(flags & RPMALLOC_NO_PRESERVE))
 			memcpy(block, old_block, old_size < new_size ? old_size : new_size);
@@ -1765,7 +2787,7 @@ heap_reallocate_block(heap_t* heap, void* block, size_t size, size_t old_size, u
 static void*
 heap_reallocate_block_aligned(heap_t* heap, void* block, size_t alignment, size_t size, size_t old_size,
                               unsigned int flags) {
-	if (alignment <= SMALL_GRANULARITY)
+	if (alignment <= BLOCK_MIN_ALIGNMENT)
 		return heap_reallocate_block(heap, block, size, old_size, flags);
 
 	int no_alloc = !!(flags & RPMALLOC_GROW_OR_FAIL);
@@ -1789,12 +2811,92 @@ heap_reallocate_block_aligned(heap_t* heap, void* block, size_t alignment, size_
 	return block;
 }
 
+//! Reorder the available pages of a size class by occupancy, fullest first, so allocations keep draining the
+//  sparsest pages. Pages are bucketed by the fraction of used blocks, keeping their order within a bucket
+static void
+heap_page_available_sort(heap_t* heap, uint32_t size_class) {
+	page_t* page = heap->page_available[size_class];
+	if (!page || !page->next)
+		return;
+	page_t* bucket_head[PAGE_OCCUPANCY_BUCKETS] = {0};
+	page_t* bucket_tail[PAGE_OCCUPANCY_BUCKETS] = {0};
+	while (page) {
+		page_t* next_page = page->next;
+		uint32_t ibucket = (uint32_t)(((uint64_t)page->block_used * PAGE_OCCUPANCY_BUCKETS) / (page->block_count + 1));
+		ibucket = (PAGE_OCCUPANCY_BUCKETS - 1) - ibucket;
+		page->next = 0;
+		page->prev = bucket_tail[ibucket];
+		if (bucket_tail[ibucket])
+			bucket_tail[ibucket]->next = page;
+		else
+			bucket_head[ibucket] = page;
+		bucket_tail[ibucket] = page;
+		page = next_page;
+	}
+	page_t* tail = 0;
+	heap->page_available[size_class] = 0;
+	for (uint32_t ibucket = 0; ibucket < PAGE_OCCUPANCY_BUCKETS; ++ibucket) {
+		if (!bucket_head[ibucket])
+			continue;
+		if (tail)
+			tail->next = bucket_head[ibucket];
+		else
+			heap->page_available[size_class] = bucket_head[ibucket];
+		bucket_head[ibucket]->prev = tail;
+		tail = bucket_tail[ibucket];
+	}
+}
+
+//! Reclaim blocks freed by other threads, release empty pages and decommit free pages above the retain count
+static void
+heap_collect(heap_t* heap) {
+	// Hand over blocks this thread freed to pages of other threads
+	heap_remote_free_flush(heap);
+	// Return blocks in the heap local free lists to their pages, the blocks are free but
+	// still accounted as used in the page they belong to
+	for (uint32_t iclass = 0; iclass < SIZE_CLASS_COUNT; ++iclass) {
+		block_t* block = heap->local_free[iclass];
+		heap->local_free[iclass] = 0;
+		while (block) {
+			block_t* next_block = block->next;
+			span_t* span = block_get_span(block);
+			page_put_local_free_block(span_get_page_from_block(span, block), block);
+			block = next_block;
+		}
+	}
+
+	// Full pages had their blocks freed by other threads pushed to the heap
+	for (int itype = 0; itype < 3; ++itype)
+		heap_free_thread_free_blocks(heap, (page_type_t)itype);
+
+	for (uint32_t iclass = 0; iclass < SIZE_CLASS_COUNT; ++iclass) {
+		page_t* page = heap->page_available[iclass];
+		while (page) {
+			page_t* next_page = page->next;
+			page_collect_thread_free_blocks(page);
+			if (page->block_used == 0)
+				page_available_to_free(page);
+			page = next_page;
+		}
+		heap_page_available_sort(heap, iclass);
+	}
+
+	heap_page_free_lock(heap);
+	for (int itype = 0; itype < 3; ++itype) {
+		uint32_t retain = page_free_retain((uint32_t)itype);
+		if (heap->page_free_commit_count[itype] > retain)
+			heap_page_free_decommit(heap, (uint32_t)itype, retain);
+	}
+	heap_page_free_unlock(heap);
+}
+
 static void
 heap_free_all(heap_t* heap) {
 	for (int itype = 0; itype < 3; ++itype) {
 		span_t* span = heap->span_partial[itype];
 		while (span) {
 			span_t* span_next = span->next;
+			statistics_unmap(span->mapped_size);
 			global_memory_interface->memory_unmap(span, span->offset, span->mapped_size);
 			span = span_next;
 		}
@@ -1803,20 +2905,33 @@ heap_free_all(heap_t* heap) {
 		heap->page_free_commit_count[itype] = 0;
 		atomic_store_explicit(&heap->thread_free[itype], 0, memory_order_release);
 	}
-	for (int itype = 0; itype < 4; ++itype) {
+	for (int itype = 0; itype < 3; ++itype) {
 		span_t* span = heap->span_used[itype];
 		while (span) {
 			span_t* span_next = span->next;
+			statistics_unmap(span->mapped_size);
 			global_memory_interface->memory_unmap(span, span->offset, span->mapped_size);
 			span = span_next;
 		}
 		heap->span_used[itype] = 0;
 	}
+	span_t* span = heap_huge_span_detach(heap);
+	while (span) {
+		span_t* span_next = (span_t*)span->page.next;
+		statistics_huge_free(huge_span_size(span));
+		statistics_unmap(span->mapped_size);
+		global_memory_interface->memory_unmap(span, span->offset, span->mapped_size);
+		span = span_next;
+	}
 	memset(heap->local_free, 0, sizeof(heap->local_free));
 	memset(heap->page_available, 0, sizeof(heap->page_available));
 
 #if ENABLE_STATISTICS
-	// TODO: Fix
+	// Every block and span owned by the heap is now released, keep the totals
+	for (uint32_t iclass = 0; iclass < SIZE_CLASS_COUNT; ++iclass)
+		heap->statistics.size_use[iclass].free_total = heap->statistics.size_use[iclass].alloc_total;
+	for (int itype = 0; itype < 4; ++itype)
+		heap->statistics.span_use[itype].current = 0;
 #endif
 }
 
@@ -1862,6 +2977,23 @@ rpfree(void* ptr) {
 	block_deallocate(ptr);
 }
 
+size_t
+rpmalloc_batch(size_t size, size_t count, void** blocks) {
+#if ENABLE_VALIDATE_ARGS
+	if (size >= MAX_ALLOC_SIZE) {
+		errno = EINVAL;
+		return 0;
+	}
+#endif
+	heap_t* heap = get_thread_heap();
+	return heap_allocate_block_batch(heap, size, count, blocks);
+}
+
+void
+rpfree_batch(void** blocks, size_t count) {
+	block_deallocate_batch(blocks, count);
+}
+
 extern inline RPMALLOC_ALLOCATOR void*
 rpcalloc(size_t num, size_t size) {
 	size_t total;
@@ -2011,6 +3143,36 @@ rpmalloc_initialize_config(rpmalloc_interface_t* memory_interface, rpmalloc_conf
 	return result;
 }
 
+//! Select the span geometry profile and derive the size class to page type mapping
+static void
+rpmalloc_set_span_geometry(int geometry) {
+	if ((geometry != RPMALLOC_SPAN_GEOMETRY_LARGE) && (geometry != RPMALLOC_SPAN_GEOMETRY_COMPACT))
+		geometry = ARCH_32BIT ? RPMALLOC_SPAN_GEOMETRY_COMPACT : RPMALLOC_SPAN_GEOMETRY_LARGE;
+	global_config.span_geometry = geometry;
+
+	const span_geometry_t* profile = global_span_geometry + (geometry - 1);
+	global_span_size = profile->span_size;
+	global_span_mask = ~((uintptr_t)profile->span_size - 1);
+	for (int itype = 0; itype < 3; ++itype) {
+		global_page_size[itype] = profile->page_size[itype];
+		global_page_mask[itype] = ~((uintptr_t)profile->page_size[itype] - 1);
+		global_block_size_limit[itype] = profile->block_size_limit[itype];
+	}
+
+	// Size classes are ordered by block size, so each page type serves a contiguous range of classes
+	uint32_t iclass = 0;
+	for (int itype = 0; itype < 3; ++itype) {
+		while ((iclass < SIZE_CLASS_COUNT) && (global_size_class[iclass].block_size <= profile->block_size_limit[itype])) {
+			global_size_class[iclass].block_count =
+			    (uint32_t)((profile->page_size[itype] - PAGE_HEADER_SIZE) / global_size_class[iclass].block_size);
+			++iclass;
+		}
+		global_size_class_limit[itype] = iclass;
+	}
+	while (iclass < SIZE_CLASS_COUNT)
+		global_size_class[iclass++].block_count = 0;
+}
+
 extern int
 rpmalloc_initialize(rpmalloc_interface_t* memory_interface) {
 	if (global_rpmalloc_initialized) {
@@ -2116,6 +3278,30 @@ rpmalloc_initialize(rpmalloc_interface_t* memory_interface) {
 	if (global_config.enable_huge_pages || global_config.page_size > (256 * 1024))
 		global_config.disable_decommit = 1;
 
+	rpmalloc_set_span_geometry(global_config.span_geometry);
+
+	for (int itype = 0; itype < 3; ++itype) {
+		if (global_config.thread_cache_limit[itype]) {
+			size_t page_count = global_config.thread_cache_limit[itype] / global_page_size[itype];
+			global_page_free_overflow[itype] = page_count ? (uint32_t)page_count : 1;
+			global_page_free_retain[itype] = global_page_free_overflow[itype] / 4;
+		}
+		global_config.thread_cache_limit[itype] = (size_t)global_page_free_overflow[itype] * global_page_size[itype];
+	}
+
+	if (!global_config.huge_cache_size)
+		global_config.huge_cache_size = (ARCH_32BIT ? 64 : 256) * 1024 * 1024;
+	global_huge_cache_limit = global_config.disable_huge_cache ? 0 : global_config.huge_cache_size;
+
+	// Reallocation headroom must not be charged against the commit limit. The default Windows map function
+	// commits everything it maps when decommit is unavailable, custom memory interfaces are expected to
+	// implement commit and decommit
+	global_huge_reserve_uncommitted = 1;
+#if PLATFORM_WINDOWS
+	if (global_memory_interface->memory_decommit == os_mdecommit)
+		global_huge_reserve_uncommitted = ENABLE_DECOMMIT && !global_config.disable_decommit;
+#endif
+
 #if defined(__linux__) || defined(__ANDROID__)
 	if (global_config.disable_thp)
 		(void)prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0);
@@ -2143,19 +3329,14 @@ extern void
 rpmalloc_finalize(void) {
 	rpmalloc_thread_finalize();
 
+	global_cache_finalize(global_config.unmap_on_finalize);
+	huge_cache_finalize(global_config.unmap_on_finalize);
+
 	if (global_config.unmap_on_finalize) {
-		heap_t* heap = global_heap_queue;
-		global_heap_queue = 0;
+		heap_t* heap = (heap_t*)atomic_exchange_explicit(&global_heap_list, 0, memory_order_acquire);
+		atomic_store_explicit(&global_heap_queue, 0, memory_order_release);
 		while (heap) {
-			heap_t* heap_next = heap->next;
-			heap_free_all(heap);
-			heap_unmap(heap);
-			heap = heap_next;
-		}
-		heap = global_heap_used;
-		global_heap_used = 0;
-		while (heap) {
-			heap_t* heap_next = heap->next;
+			heap_t* heap_next = heap->next_heap;
 			heap_free_all(heap);
 			heap_unmap(heap);
 			heap = heap_next;
@@ -2194,15 +3375,129 @@ rpmalloc_thread_finalize(void) {
 
 extern void
 rpmalloc_thread_collect(void) {
+	heap_t* heap = get_thread_heap();
+	if (heap != global_heap_default)
+		heap_collect(heap);
+	huge_cache_evict();
+}
+
+void
+rpmalloc_set_memory_pressure(unsigned int level) {
+	if (level > RPMALLOC_MEMORY_PRESSURE_CRITICAL)
+		level = RPMALLOC_MEMORY_PRESSURE_CRITICAL;
+	unsigned int previous = atomic_exchange_explicit(&global_memory_pressure, level, memory_order_relaxed);
+	// Shrinking the huge block cache releases address space right away, free pages are decommitted
+	// on the next free or collect in each heap
+	if (level > previous)
+		huge_cache_evict();
+}
+
+unsigned int
+rpmalloc_memory_pressure(void) {
+	return atomic_load_explicit(&global_memory_pressure, memory_order_relaxed);
+}
+
+size_t
+rpmalloc_scavenge(size_t byte_limit, unsigned int min_age_ms) {
+	return global_cache_scavenge(byte_limit, min_age_ms);
+}
+
+size_t
+rpmalloc_trim_idle_heaps(unsigned int idle_ms) {
+	size_t trimmed = 0;
+	uint32_t now = os_tick_ms();
+	heap_t* heap = (heap_t*)atomic_load_explicit(&global_heap_list, memory_order_acquire);
+	for (; heap; heap = heap->next_heap) {
+		// First class heaps never share pages, a heap busy with its free pages is not idle
+		if (!heap->owner_thread ||
+		    ((uint32_t)(now - atomic_load_explicit(&heap->active_tick, memory_order_relaxed)) < idle_ms))
+			continue;
+		if (atomic_exchange_explicit(&heap->page_free_lock, 1, memory_order_acquire))
+			continue;
+		trimmed += heap_page_free_trim(heap);
+		heap_page_free_unlock(heap);
+	}
+	return trimmed;
+}
+
+void
+rpmalloc_thread_statistics(rpmalloc_thread_statistics_t* stats) {
+	memset(stats, 0, sizeof(rpmalloc_thread_statistics_t));
+	heap_t* heap = get_thread_heap();
+	if (heap == global_heap_default)
+		return;
+
+	for (uint32_t iclass = 0; iclass < SIZE_CLASS_COUNT; ++iclass) {
+		size_t block_count = 0;
+		for (block_t* block = heap->local_free[iclass]; block; block = block->next)
+			++block_count;
+		stats->sizecache += block_count * global_size_class[iclass].block_size;
+	}
+	heap_page_free_lock(heap);
+	for (int itype = 0; itype < 3; ++itype) {
+		for (page_t* page = heap->page_free[itype]; page; page = page->next)
+			stats->spancache += global_page_size[itype];
+	}
+	heap_page_free_unlock(heap);
+
+#if ENABLE_STATISTICS
+	for (int itype = 0; itype < 4; ++itype) {
+		stats->span_use[itype].current = heap->statistics.span_use[itype].current;
+		stats->span_use[itype].peak = heap->statistics.span_use[itype].peak;
+		stats->span_use[itype].to_global = heap->statistics.span_use[itype].to_global;
+		stats->span_use[itype].from_global = heap->statistics.span_use[itype].from_global;
+		stats->span_use[itype].map_calls = heap->statistics.span_use[itype].map_calls;
+	}
+	stats->thread_to_global = heap->statistics.thread_to_global;
+	stats->global_to_thread = heap->statistics.global_to_thread;
+	for (uint32_t iclass = 0; iclass < SIZE_CLASS_COUNT; ++iclass) {
+		stats->size_use[iclass].alloc_current =
+		    heap->statistics.size_use[iclass].alloc_total - heap->statistics.size_use[iclass].free_total;
+		stats->size_use[iclass].alloc_peak = heap->statistics.size_use[iclass].alloc_peak;
+		stats->size_use[iclass].alloc_total = heap->statistics.size_use[iclass].alloc_total;
+		stats->size_use[iclass].free_total = heap->statistics.size_use[iclass].free_total;
+		stats->size_use[iclass].spans_to_cache = heap->statistics.size_use[iclass].page_to_free;
+		stats->size_use[iclass].spans_from_cache = heap->statistics.size_use[iclass].page_from_free;
+		stats->size_use[iclass].spans_from_reserved = heap->statistics.size_use[iclass].page_from_span;
+		stats->size_use[iclass].map_calls = heap->statistics.size_use[iclass].map_calls;
+	}
+#endif
+}
+
+void
+rpmalloc_global_statistics(rpmalloc_global_statistics_t* stats) {
+	memset(stats, 0, sizeof(rpmalloc_global_statistics_t));
+	for (int itype = 0; itype < 3; ++itype) {
+		int page_count = atomic_load_explicit(&global_page_cache_count[itype], memory_order_relaxed);
+		int span_count = atomic_load_explicit(&global_span_cache_count[itype], memory_order_relaxed);
+		if (page_count > 0)
+			stats->cached += (size_t)page_count * global_page_size[itype];
+		if (span_count > 0)
+			stats->cached += (size_t)span_count * global_span_size;
+	}
+	stats->cached += atomic_load_explicit(&global_huge_cache_size, memory_order_relaxed);
+#if ENABLE_STATISTICS
+	stats->mapped = atomic_load_explicit(&global_statistics.mapped, memory_order_relaxed);
+	stats->mapped_peak = atomic_load_explicit(&global_statistics.mapped_peak, memory_order_relaxed);
+	stats->mapped_total = atomic_load_explicit(&global_statistics.mapped_total, memory_order_relaxed);
+	stats->unmapped_total = atomic_load_explicit(&global_statistics.unmapped_total, memory_order_relaxed);
+	stats->huge_alloc = atomic_load_explicit(&global_statistics.huge_alloc, memory_order_relaxed);
+	stats->huge_alloc_peak = atomic_load_explicit(&global_statistics.huge_alloc_peak, memory_order_relaxed);
+#endif
 }
 
 void
 rpmalloc_dump_statistics(void* file) {
 #if ENABLE_STATISTICS
-	fprintf(file, "Mapped pages:        %llu\n",
-	        (unsigned long long)atomic_load_explicit(&global_statistics.page_mapped, memory_order_relaxed));
-	fprintf(file, "Mapped pages (peak): %llu\n",
-	        (unsigned long long)atomic_load_explicit(&global_statistics.page_mapped_peak, memory_order_relaxed));
+	rpmalloc_global_statistics_t global_stats;
+	rpmalloc_global_statistics(&global_stats);
+	fprintf(file, "Mapped:              %llu KiB\n", (unsigned long long)(global_stats.mapped / 1024));
+	fprintf(file, "Mapped (peak):       %llu KiB\n", (unsigned long long)(global_stats.mapped_peak / 1024));
+	fprintf(file, "Mapped (total):      %llu KiB\n", (unsigned long long)(global_stats.mapped_total / 1024));
+	fprintf(file, "Unmapped (total):    %llu KiB\n", (unsigned long long)(global_stats.unmapped_total / 1024));
+	fprintf(file, "Cached:              %llu KiB\n", (unsigned long long)(global_stats.cached / 1024));
+	fprintf(file, "Huge:                %llu KiB\n", (unsigned long long)(global_stats.huge_alloc / 1024));
+	fprintf(file, "Huge (peak):         %llu KiB\n", (unsigned long long)(global_stats.huge_alloc_peak / 1024));
 	fprintf(file, "Active pages:        %llu\n",
 	        (unsigned long long)atomic_load_explicit(&global_statistics.page_active, memory_order_relaxed));
 	fprintf(file, "Active pages (peak): %llu\n",
@@ -2213,6 +3508,26 @@ rpmalloc_dump_statistics(void* file) {
 	        (unsigned long long)atomic_load_explicit(&global_statistics.page_decommit, memory_order_relaxed));
 	fprintf(file, "Heaps created:       %llu\n",
 	        (unsigned long long)atomic_load_explicit(&global_statistics.heap_count, memory_order_relaxed));
+
+	heap_t* heap = get_thread_heap();
+	if (heap == global_heap_default)
+		return;
+	fprintf(file, "Class   Size  AllocCur  AllocPeak  AllocTotal   FreeTotal  ToFree  FromFree  FromSpan  Maps\n");
+	for (uint32_t iclass = 0; iclass < SIZE_CLASS_COUNT; ++iclass) {
+		if (!heap->statistics.size_use[iclass].alloc_total)
+			continue;
+		fprintf(file, "%5u %6u %9llu %10llu %11llu %11llu %7llu %9llu %9llu %5llu\n", iclass,
+		        global_size_class[iclass].block_size,
+		        (unsigned long long)(heap->statistics.size_use[iclass].alloc_total -
+		                             heap->statistics.size_use[iclass].free_total),
+		        (unsigned long long)heap->statistics.size_use[iclass].alloc_peak,
+		        (unsigned long long)heap->statistics.size_use[iclass].alloc_total,
+		        (unsigned long long)heap->statistics.size_use[iclass].free_total,
+		        (unsigned long long)heap->statistics.size_use[iclass].page_to_free,
+		        (unsigned long long)heap->statistics.size_use[iclass].page_from_free,
+		        (unsigned long long)heap->statistics.size_use[iclass].page_from_span,
+		        (unsigned long long)heap->statistics.size_use[iclass].map_calls);
+	}
 #else
 	(void)sizeof(file);
 #endif
@@ -2234,8 +3549,15 @@ rpmalloc_heap_acquire(void) {
 
 void
 rpmalloc_heap_release(rpmalloc_heap_t* heap) {
-	if (heap)
-		heap_release(heap);
+	if (!heap)
+		return;
+	// A heap still owning spans is left alone, blocks can still be freed to it and a thread adopting
+	// it would race with those frees. It stays in the global heap list until finalization.
+	for (int itype = 0; itype < 4; ++itype) {
+		if (heap->span_used[itype] || ((itype < 3) && heap->span_partial[itype]))
+			return;
+	}
+	heap_release(heap);
 }
 
 RPMALLOC_ALLOCATOR void*
@@ -2320,7 +3642,7 @@ rpmalloc_heap_realloc(rpmalloc_heap_t* heap, void* ptr, size_t size, unsigned in
 RPMALLOC_ALLOCATOR void*
 rpmalloc_heap_aligned_realloc(rpmalloc_heap_t* heap, void* ptr, size_t alignment, size_t size, unsigned int flags) {
 #if ENABLE_VALIDATE_ARGS
-	if ((size + alignment < size) || (alignment > _memory_page_size)) {
+	if ((size + alignment < size) || (alignment > global_config.page_size)) {
 		errno = EINVAL;
 		return 0;
 	}
@@ -2330,8 +3652,19 @@ rpmalloc_heap_aligned_realloc(rpmalloc_heap_t* heap, void* ptr, size_t alignment
 
 void
 rpmalloc_heap_free(rpmalloc_heap_t* heap, void* ptr) {
-	(void)sizeof(heap);
-	block_deallocate(ptr);
+	if (!ptr)
+		return;
+	span_t* span = block_get_span(ptr);
+	page_t* page = span_get_page_from_block(span, ptr);
+	if ((page->heap == heap) && (page->page_type != PAGE_HUGE)) {
+		// Caller has exclusive use of the heap, free directly to the page local free list
+		if (page->has_aligned_block)
+			ptr = page_block_realign(page, ptr);
+		heap_statistics_free(heap, page->size_class, 1);
+		page_put_local_free_block(page, ptr);
+	} else {
+		block_deallocate(ptr);
+	}
 }
 
 //! Free all memory allocated by the heap
@@ -2340,6 +3673,11 @@ rpmalloc_heap_free_all(rpmalloc_heap_t* heap) {
 	heap_free_all(heap);
 }
 
+void
+rpmalloc_heap_collect(rpmalloc_heap_t* heap) {
+	heap_collect(heap);
+}
+
 extern inline void
 rpmalloc_heap_thread_set_current(rpmalloc_heap_t* heap) {
 	heap_t* prev_heap = get_thread_heap();
@@ -2353,7 +3691,7 @@ rpmalloc_heap_thread_set_current(rpmalloc_heap_t* heap) {
 rpmalloc_heap_t*
 rpmalloc_get_heap_for_ptr(void* ptr) {
 	// Grab the span, and then the heap from the span
-	span_t* span = (span_t*)((uintptr_t)ptr & SPAN_MASK);
+	span_t* span = (span_t*)((uintptr_t)ptr & global_span_mask);
 	if (span)
 		return span_get_page_from_block(span, ptr)->heap;
 	return 0;
@@ -66,19 +66,27 @@ extern "C" {
 //  a new block).
 #define RPMALLOC_GROW_OR_FAIL 2
 
+//! Span geometry selected by the platform: compact profile for 32-bit processes, large profile otherwise
+#define RPMALLOC_SPAN_GEOMETRY_AUTO 0
+//! 256MiB spans with 64KiB/4MiB/64MiB small/medium/large pages, blocks above 8MiB are huge
+#define RPMALLOC_SPAN_GEOMETRY_LARGE 1
+//! 4MiB spans with 16KiB/256KiB/2MiB small/medium/large pages, blocks above 256KiB are huge. Keeps the
+//  virtual address space reserved per thread heap small enough for 32-bit processes.
+#define RPMALLOC_SPAN_GEOMETRY_COMPACT 2
+
 typedef struct rpmalloc_global_statistics_t {
 	//! Current amount of virtual memory mapped, all of which might not have been committed (only if
 	//! ENABLE_STATISTICS=1)
 	size_t mapped;
 	//! Peak amount of virtual memory mapped, all of which might not have been committed (only if ENABLE_STATISTICS=1)
 	size_t mapped_peak;
-	//! Current amount of memory in global caches for small and medium sizes (<32KiB)
+	//! Current amount of memory in the global page, span and huge block caches, cached spans count as a full span
 	size_t cached;
-	//! Current amount of memory allocated in huge allocations, i.e larger than LARGE_SIZE_LIMIT which is 2MiB by
-	//! default (only if ENABLE_STATISTICS=1)
+	//! Current amount of memory allocated in huge allocations, i.e larger than the large block limit of the span
+	//! geometry (only if ENABLE_STATISTICS=1)
 	size_t huge_alloc;
-	//! Peak amount of memory allocated in huge allocations, i.e larger than LARGE_SIZE_LIMIT which is 2MiB by default
-	//! (only if ENABLE_STATISTICS=1)
+	//! Peak amount of memory allocated in huge allocations, i.e larger than the large block limit of the span
+	//! geometry (only if ENABLE_STATISTICS=1)
 	size_t huge_alloc_peak;
 	//! Total amount of memory mapped since initialization (only if ENABLE_STATISTICS=1)
 	size_t mapped_total;
@@ -91,11 +99,12 @@ typedef struct rpmalloc_thread_statistics_t {
 	size_t sizecache;
 	//! Current number of bytes available in thread span caches for small and medium sizes (<32KiB)
 	size_t spancache;
-	//! Total number of bytes transitioned from thread cache to global cache (only if ENABLE_STATISTICS=1)
+	//! Total number of bytes of free pages transitioned from thread heap to global cache (only if ENABLE_STATISTICS=1)
 	size_t thread_to_global;
-	//! Total number of bytes transitioned from global cache to thread cache (only if ENABLE_STATISTICS=1)
+	//! Total number of bytes of free pages transitioned from global cache to thread heap (only if ENABLE_STATISTICS=1)
 	size_t global_to_thread;
-	//! Per span count statistics (only if ENABLE_STATISTICS=1)
+	//! Per span statistics indexed by page type, small, medium, large and huge. Huge spans only count map calls,
+	//! current huge use is in the global statistics (only if ENABLE_STATISTICS=1)
 	struct {
 		//! Currently used number of spans
 		size_t current;
@@ -116,7 +125,8 @@ typedef struct rpmalloc_thread_statistics_t {
 		//! Number of raw memory map calls (not hitting the reserve spans but resulting in actual OS mmap calls)
 		size_t map_calls;
 	} span_use[64];
-	//! Per size class statistics (only if ENABLE_STATISTICS=1)
+	//! Per size class statistics. Blocks freed by other threads are counted once the owning thread adopts them
+	//! (only if ENABLE_STATISTICS=1)
 	struct {
 		//! Current number of allocations
 		size_t alloc_current;
@@ -126,11 +136,11 @@ typedef struct rpmalloc_thread_statistics_t {
 		size_t alloc_total;
 		//! Total number of frees
 		size_t free_total;
-		//! Number of spans transitioned to cache
+		//! Number of pages released to the heap free page list
 		size_t spans_to_cache;
-		//! Number of spans transitioned from cache
+		//! Number of pages reused from the heap free page list
 		size_t spans_from_cache;
-		//! Number of spans transitioned from reserved state
+		//! Number of pages initialized from a partially used span
 		size_t spans_from_reserved;
 		//! Number of raw memory map calls (not hitting the reserve spans but resulting in actual OS mmap calls)
 		size_t map_calls;
@@ -188,6 +198,22 @@ typedef struct rpmalloc_config_t {
 	//  when process exits, but if using rpmalloc in a dynamic library you might want to unmap
 	//  all pages when the dynamic library unloads to avoid process memory leaks and bloat.
 	int unmap_on_finalize;
+	//! Span and page geometry profile, one of the RPMALLOC_SPAN_GEOMETRY_* values. Set to 0
+	//  to select automatically based on the pointer size. Updated with the selected profile
+	//  on initialization.
+	int span_geometry;
+	//! Maximum number of bytes of address space mapped by freed huge blocks kept for reuse by later huge
+	//  allocations of similar size. Set to 0 to use the default, 64MiB on 32-bit and 256MiB on 64-bit.
+	size_t huge_cache_size;
+	//! Disable the huge block cache if set to 1, huge blocks are then unmapped as soon as they are freed
+	int disable_huge_cache;
+	//! Defer decommitting free pages to rpmalloc_scavenge if set to 1. Heaps then hand excess free pages
+	//  to the global page cache instead of decommitting them on the freeing thread.
+	int enable_scavenger;
+	//! Maximum number of bytes of committed free pages each thread heap keeps for small, medium and large
+	//  pages. Excess free pages are handed to the global page cache or decommitted. Set to 0 to use the
+	//  default of 16, 8 and 2 pages. Updated with the effective limits on initialization.
+	size_t thread_cache_limit[3];
 #if defined(__linux__) || defined(__ANDROID__)
 	///! Allows to disable the Transparent Huge Page feature on Linux on a process basis,
 	///  rather than enabling/disabling system-wise (done via /sys/kernel/mm/transparent_hugepage/enabled).
@@ -221,10 +247,38 @@ rpmalloc_thread_initialize(void);
 RPMALLOC_EXPORT void
 rpmalloc_thread_finalize(void);
 
-//! Perform deferred deallocations pending for the calling thread heap
+//! Perform deferred deallocations pending for the calling thread heap and unmap expired cached huge blocks
 RPMALLOC_EXPORT void
 rpmalloc_thread_collect(void);
 
+//! Memory pressure levels, see rpmalloc_set_memory_pressure
+#define RPMALLOC_MEMORY_PRESSURE_NONE 0
+#define RPMALLOC_MEMORY_PRESSURE_MODERATE 1
+#define RPMALLOC_MEMORY_PRESSURE_HIGH 2
+#define RPMALLOC_MEMORY_PRESSURE_CRITICAL 3
+
+//! Set the memory pressure level. Each level halves the number of free pages heaps keep committed
+//  and quarters the size of the huge block cache, raising the level evicts the huge block cache
+RPMALLOC_EXPORT void
+rpmalloc_set_memory_pressure(unsigned int level);
+
+//! Get the current memory pressure level
+RPMALLOC_EXPORT unsigned int
+rpmalloc_memory_pressure(void);
+
+//! Decommit free pages that have stayed in the global page cache for at least the given number of
+//  milliseconds, stopping after the given number of bytes. Meant to be called periodically from a
+//  background thread when enable_scavenger is set. Returns the number of bytes decommitted.
+RPMALLOC_EXPORT size_t
+rpmalloc_scavenge(size_t byte_limit, unsigned int min_age_ms);
+
+//! Hand all free pages of thread heaps without page level activity for at least the given number of
+//  milliseconds to the global page cache, decommitted unless enable_scavenger is set. Safe to call from
+//  any thread, heaps busy with their free pages are skipped. Returns the number of committed bytes
+//  released from the heaps.
+RPMALLOC_EXPORT size_t
+rpmalloc_trim_idle_heaps(unsigned int idle_ms);
+
 //! Query if allocator is initialized for calling thread
 RPMALLOC_EXPORT int
 rpmalloc_is_thread_initialized(void);
@@ -305,6 +359,16 @@ rpposix_memalign(void** memptr, size_t alignment, size_t size);
 RPMALLOC_EXPORT void
 rpfree(void* ptr);
 
+//! Allocate up to count memory blocks of at least the given size into the blocks array, taking whole
+//  free lists at a time. Returns the number of blocks allocated, less than count only if out of memory
+RPMALLOC_EXPORT size_t
+rpmalloc_batch(size_t size, size_t count, void** blocks);
+
+//! Free the given memory blocks, null pointers are ignored. Blocks owned by other threads are linked up
+//  per page and handed over with one atomic operation per page instead of one per block
+RPMALLOC_EXPORT void
+rpfree_batch(void** blocks, size_t count);
+
 //! Query the usable size of the given memory block (from given pointer to the end of block)
 RPMALLOC_EXPORT size_t
 rpmalloc_usable_size(void* ptr);
@@ -379,6 +443,11 @@ rpmalloc_heap_free(rpmalloc_heap_t* heap, void* ptr);
 RPMALLOC_EXPORT void
 rpmalloc_heap_free_all(rpmalloc_heap_t* heap);
 
+//! Reclaim blocks freed to the heap through the generic interface or by other threads and release
+//  its empty pages like rpmalloc_thread_collect does for a thread heap. Caller must own the heap.
+RPMALLOC_EXPORT void
+rpmalloc_heap_collect(rpmalloc_heap_t* heap);
+
 //! Set the given heap as the current heap for the calling thread. A heap MUST only be current heap
 //  for a single thread, a heap can never be shared between multiple threads. The previous
 //  current heap for the calling thread is released to be reused by other threads.
@@ -0,0 +1,174 @@
+/* heaptest.c  -  Regression tests for rpmalloc first class heaps
+ *
+ * Exercises the paths that hand blocks of a first class heap (rpmalloc_heap_acquire) back to it from
+ * outside the heap interface: rpfree of a heap block, rpmalloc_heap_realloc moving a block, and frees
+ * from other threads, each into a full page followed by more allocations from the heap. Also does a
+ * HeapCreate style round trip: allocate, resize, free, collect and free_all on a heap that is released.
+ * Exits non-zero (or crashes) on failure.
+ *
+ * Build:  cl /O2 /DRPMALLOC_FIRST_CLASS_HEAPS=1 /DENABLE_OVERRIDE=0 /I. tools\heaptest.c rpmalloc.c
+ *         gcc -O1 -g -DRPMALLOC_FIRST_CLASS_HEAPS=1 -DENABLE_OVERRIDE=0 -DENABLE_ASSERTS=1 -I. \
+ *             -o heaptest tools/heaptest.c rpmalloc.c -lpthread
+ *
+ * This is free and unencumbered software released into the public domain.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rpmalloc.h"
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE thread_t;
+#define THREAD_PROC(name, arg) static DWORD WINAPI name(LPVOID arg)
+#define THREAD_RETURN return 0
+static thread_t
+thread_start(LPTHREAD_START_ROUTINE fn, void* arg) {
+	return CreateThread(0, 0, fn, arg, 0, 0);
+}
+static void
+thread_join(thread_t t) {
+	WaitForSingleObject(t, INFINITE);
+	CloseHandle(t);
+}
+#else
+#include <pthread.h>
+typedef pthread_t thread_t;
+#define THREAD_PROC(name, arg) static void* name(void* arg)
+#define THREAD_RETURN return 0
+static thread_t
+thread_start(void* (*fn)(void*), void* arg) {
+	pthread_t t;
+	pthread_create(&t, 0, fn, arg);
+	return t;
+}
+static void
+thread_join(thread_t t) {
+	pthread_join(t, 0);
+}
+#endif
+
+#if !RPMALLOC_FIRST_CLASS_HEAPS
+#error Build with RPMALLOC_FIRST_CLASS_HEAPS=1
+#endif
+
+//! Enough blocks to fill several pages of the tested size classes in either span geometry
+#define BLOCK_COUNT 8192
+
+static int failures;
+
+#define CHECK(cond, ...)                       \
+	do {                                       \
+		if (!(cond)) {                         \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);      \
+			fprintf(stderr, "\n");             \
+			++failures;                        \
+		}                                      \
+	} while (0)
+
+static void* blocks[BLOCK_COUNT];
+
+//! Fill pages of the heap with blocks of the given size
+static void
+fill(rpmalloc_heap_t* heap, size_t size) {
+	for (int i = 0; i < BLOCK_COUNT; ++i) {
+		blocks[i] = rpmalloc_heap_alloc(heap, size);
+		CHECK(blocks[i], "heap alloc %u failed", (unsigned)size);
+		memset(blocks[i], i & 0xFF, size);
+	}
+}
+
+//! Allocate more blocks of the size than were handed back, forcing the heap past its available pages
+static void
+allocate_past_available(rpmalloc_heap_t* heap, size_t size) {
+	for (int i = 0; i < BLOCK_COUNT; ++i) {
+		void* p = rpmalloc_heap_alloc(heap, size);
+		CHECK(p, "heap alloc %u after hand back failed", (unsigned)size);
+	}
+}
+
+static void
+test_rpfree_into_full_page(void) {
+	rpmalloc_heap_t* heap = rpmalloc_heap_acquire();
+	fill(heap, 64);
+	for (int i = 0; i < BLOCK_COUNT; i += 2)
+		rpfree(blocks[i]);
+	allocate_past_available(heap, 64);
+	rpmalloc_heap_free_all(heap);
+	rpmalloc_heap_release(heap);
+}
+
+static void
+test_realloc_moves_out_of_full_page(void) {
+	rpmalloc_heap_t* heap = rpmalloc_heap_acquire();
+	fill(heap, 64);
+	for (int i = 0; i < BLOCK_COUNT; i += 2) {
+		void* p = rpmalloc_heap_realloc(heap, blocks[i], 200, 0);
+		CHECK(p && ((unsigned char*)p)[63] == (i & 0xFF), "heap realloc 64->200 lost content");
+		blocks[i] = p;
+	}
+	allocate_past_available(heap, 64);
+	allocate_past_available(heap, 200);
+	rpmalloc_heap_free_all(heap);
+	rpmalloc_heap_release(heap);
+}
+
+THREAD_PROC(free_half, arg) {
+	void** list = arg;
+	rpmalloc_thread_initialize();
+	for (int i = 1; i < BLOCK_COUNT; i += 2)
+		rpfree(list[i]);
+	rpmalloc_thread_finalize();
+	THREAD_RETURN;
+}
+
+static void
+test_thread_free_into_full_page(void) {
+	rpmalloc_heap_t* heap = rpmalloc_heap_acquire();
+	fill(heap, 128);
+	thread_join(thread_start(free_half, blocks));
+	allocate_past_available(heap, 128);
+	rpmalloc_heap_free_all(heap);
+	rpmalloc_heap_release(heap);
+}
+
+//! The sequence the Win32 heap hooks run for a HeapCreate handle
+static void
+test_heap_round_trip(void) {
+	for (int round = 0; round < 4; ++round) {
+		rpmalloc_heap_t* heap = rpmalloc_heap_acquire();
+		fill(heap, 48);
+		for (int i = 0; i < BLOCK_COUNT; i += 3) {
+			void* p = rpmalloc_heap_realloc(heap, blocks[i], 48 + (i % 700), 0);
+			CHECK(p && ((unsigned char*)p)[47] == (i & 0xFF), "heap realloc lost content");
+			blocks[i] = p;
+		}
+		for (int i = 0; i < BLOCK_COUNT; i += 5) {
+			void* p = rpmalloc_heap_realloc(heap, blocks[i], 16, RPMALLOC_GROW_OR_FAIL);
+			CHECK(p == blocks[i], "in place shrink moved the block");
+		}
+		for (int i = 1; i < BLOCK_COUNT; i += 3)
+			rpmalloc_heap_free(heap, blocks[i]);
+		for (int i = 2; i < BLOCK_COUNT; i += 3)
+			rpfree(blocks[i]);
+		rpmalloc_heap_collect(heap);
+		allocate_past_available(heap, 48);
+		rpmalloc_heap_free_all(heap);
+		rpmalloc_heap_release(heap);
+	}
+}
+
+int
+main(void) {
+	rpmalloc_initialize(0);
+	test_rpfree_into_full_page();
+	test_realloc_moves_out_of_full_page();
+	test_thread_free_into_full_page();
+	test_heap_round_trip();
+	rpmalloc_finalize();
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,857 @@
+/* rpbench.c  -  Benchmarks for rpmalloc
+ *
+ * Runs rpmalloc on top of a counting memory interface which tracks the address space mapped and the
+ * bytes committed through the memory_map/commit/decommit/unmap callbacks, so footprint is reported
+ * without building rpmalloc with ENABLE_STATISTICS. Build the tool with the same ENABLE_DECOMMIT value
+ * as rpmalloc.c: without decommit support mappings are counted as committed up front, like the
+ * default memory interface does.
+ *
+ * Build:  cl /O2 /DENABLE_OVERRIDE=0 /I. tools\rpbench.c rpmalloc.c
+ *         gcc -O2 -DENABLE_OVERRIDE=0 -I. -o rpbench tools/rpbench.c rpmalloc.c -lpthread
+ * Usage:  rpbench geometry [threads] [ops]
+ *         rpbench threads [threads] [waves]
+ *         rpbench remote [pairs] [blocks]
+ *         rpbench footprint [blocks]
+ *         rpbench frag [rounds]
+ *
+ *   geometry  Mixed size workload (random alloc/free over a slot array, 8 bytes to 1MiB, mostly
+ *             small) on each thread, run once per span geometry profile. Reports peak mapped address
+ *             space, peak committed bytes and throughput. Threads default to 1, 4 and 16, ops to 4M
+ *             per thread.
+ *   threads   Thread create/exit bursts: each wave starts the threads at once, each allocates and
+ *             frees a few blocks and exits, taking a heap from the heap queue and handing it back.
+ *             Reports threads per second with and without the allocations, the difference is the
+ *             heap acquire/release cost under contention. Threads default to 16, waves to 2000.
+ *   remote    Producer/consumer pairs: producers allocate 16-256 byte blocks and pass them through a
+ *             ring to their consumer which frees them, every free is a cross-thread free. Consumers
+ *             call rpmalloc_thread_collect every 4096 blocks as their safe point. Reports blocks per
+ *             second against the same work allocated and freed on one thread. Pairs default to 4,
+ *             blocks to 4M per pair.
+ *   footprint Allocates blocks with a game-like size distribution dominated by tiny objects (string
+ *             buffers, list nodes, refcounted handles) and keeps them live. Reports requested bytes,
+ *             block bytes (sum of rpmalloc_usable_size) and committed bytes. Build rpmalloc.c and the
+ *             tool with -DENABLE_TINY_GRANULARITY=0 or 1 to compare the 16 and 8 byte size class
+ *             tiers, the tier in use is detected from the block size of a 4 byte request. Blocks
+ *             default to 4M.
+ *   frag      Churn after an unload: allocates 400k blocks of 16-96 bytes, frees most of them with a
+ *             survival rate shared by each run of 2000 allocations (a cell unload), then does rounds of
+ *             one-for-one free/allocate churn with a rpmalloc_thread_collect per round. Reports live
+ *             bytes, small pages holding live blocks and committed bytes every 20 rounds. Rounds
+ *             default to 200.
+ *
+ * Throughput numbers are only comparable between runs on the same machine. Compare a tree against
+ * the previous one by building the tool against both copies of rpmalloc.c.
+ *
+ * This is free and unencumbered software released into the public domain.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rpmalloc.h"
+
+#ifndef ENABLE_DECOMMIT
+#define ENABLE_DECOMMIT 1
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE thread_t;
+#define THREAD_PROC(name, arg) static DWORD WINAPI name(LPVOID arg)
+#define THREAD_RETURN return 0
+static thread_t
+thread_start(LPTHREAD_START_ROUTINE fn, void* arg) {
+	return CreateThread(0, 0, fn, arg, 0, 0);
+}
+static void
+thread_join(thread_t t) {
+	WaitForSingleObject(t, INFINITE);
+	CloseHandle(t);
+}
+static double
+time_now(void) {
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double)now.QuadPart / (double)freq.QuadPart;
+}
+static long long
+counter_add(volatile long long* value, long long delta) {
+	return InterlockedExchangeAdd64(value, delta) + delta;
+}
+static void
+counter_max(volatile long long* peak, long long value) {
+	long long cur = *peak;
+	while ((value > cur) && (InterlockedCompareExchange64(peak, value, cur) != cur))
+		cur = *peak;
+}
+//! Map exactly the aligned range, like the default interface: find a free range by reserving a padded
+//  one, then release it and map the aligned part. Falls back to the padded range
+static void*
+os_map(size_t size, size_t alignment, int commit, size_t* offset, size_t* mapped_size) {
+	DWORD type = MEM_RESERVE | (commit ? MEM_COMMIT : 0);
+	*offset = 0;
+	*mapped_size = size;
+	for (int attempt = 0; alignment && (attempt < 8); ++attempt) {
+		char* probe = VirtualAlloc(0, size + alignment, MEM_RESERVE, PAGE_NOACCESS);
+		if (!probe)
+			return 0;
+		uintptr_t aligned = ((uintptr_t)probe + (alignment - 1)) & ~(uintptr_t)(alignment - 1);
+		VirtualFree(probe, 0, MEM_RELEASE);
+		void* ptr = VirtualAlloc((void*)aligned, size, type, PAGE_READWRITE);
+		if (ptr)
+			return ptr;
+	}
+	char* base = VirtualAlloc(0, size + alignment, type, PAGE_READWRITE);
+	if (!base || !alignment)
+		return base;
+	uintptr_t aligned = ((uintptr_t)base + (alignment - 1)) & ~(uintptr_t)(alignment - 1);
+	*offset = (size_t)(aligned - (uintptr_t)base);
+	*mapped_size = size + alignment;
+	return (void*)aligned;
+}
+static void
+os_commit(void* address, size_t size) {
+	VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE);
+}
+static void
+os_decommit(void* address, size_t size) {
+	VirtualFree(address, size, MEM_DECOMMIT);
+}
+static void
+os_release(void* address, size_t size) {
+	(void)sizeof(size);
+	VirtualFree(address, 0, MEM_RELEASE);
+}
+typedef CRITICAL_SECTION lock_t;
+#define lock_init(l) InitializeCriticalSection(l)
+#define lock_acquire(l) EnterCriticalSection(l)
+#define lock_release(l) LeaveCriticalSection(l)
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+typedef pthread_t thread_t;
+#define THREAD_PROC(name, arg) static void* name(void* arg)
+#define THREAD_RETURN return 0
+static thread_t
+thread_start(void* (*fn)(void*), void* arg) {
+	pthread_t t;
+	pthread_create(&t, 0, fn, arg);
+	return t;
+}
+static void
+thread_join(thread_t t) {
+	pthread_join(t, 0);
+}
+static double
+time_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+static long long
+counter_add(volatile long long* value, long long delta) {
+	return __atomic_add_fetch(value, delta, __ATOMIC_RELAXED);
+}
+static void
+counter_max(volatile long long* peak, long long value) {
+	long long cur = __atomic_load_n(peak, __ATOMIC_RELAXED);
+	while ((value > cur) &&
+	       !__atomic_compare_exchange_n(peak, &cur, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+}
+//! Map exactly the aligned range, like the default interface: map a padded range and trim the head
+//  and tail. Anonymous mappings are backed on first touch, commit is only counted
+static void*
+os_map(size_t size, size_t alignment, int commit, size_t* offset, size_t* mapped_size) {
+	(void)sizeof(commit);
+	char* base = mmap(0, size + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		return 0;
+	*offset = 0;
+	*mapped_size = size;
+	if (!alignment)
+		return base;
+	uintptr_t aligned = ((uintptr_t)base + (alignment - 1)) & ~(uintptr_t)(alignment - 1);
+	size_t head = (size_t)(aligned - (uintptr_t)base);
+	if (head)
+		munmap(base, head);
+	if (alignment - head)
+		munmap((char*)aligned + size, alignment - head);
+	return (void*)aligned;
+}
+static void
+os_commit(void* address, size_t size) {
+	(void)sizeof(address);
+	(void)sizeof(size);
+}
+static void
+os_decommit(void* address, size_t size) {
+	madvise(address, size, MADV_DONTNEED);
+}
+static void
+os_release(void* address, size_t size) {
+	munmap(address, size);
+}
+typedef pthread_mutex_t lock_t;
+#define lock_init(l) pthread_mutex_init(l, 0)
+#define lock_acquire(l) pthread_mutex_lock(l)
+#define lock_release(l) pthread_mutex_unlock(l)
+#endif
+
+////////////
+///
+/// Counting memory interface
+///
+//////
+
+//! Largest number of live mappings tracked
+#define MAPPING_COUNT 65536
+
+//! A mapping and the bytes committed in it, kept sorted by address
+typedef struct mapping_t {
+	char* base;
+	size_t size;
+	size_t committed;
+} mapping_t;
+
+static mapping_t mappings[MAPPING_COUNT];
+static int mapping_count;
+static lock_t mapping_lock;
+
+static volatile long long mapped_bytes;
+static volatile long long mapped_peak;
+static volatile long long committed_bytes;
+static volatile long long committed_peak;
+
+static void
+footprint_reset(void) {
+	mapped_peak = mapped_bytes;
+	committed_peak = committed_bytes;
+}
+
+//! Index of the first mapping above the address
+static int
+mapping_upper_bound(const void* address) {
+	int lo = 0, hi = mapping_count;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (mappings[mid].base <= (const char*)address)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static mapping_t*
+mapping_find(const void* address) {
+	int i = mapping_upper_bound(address);
+	if (i && ((const char*)address < mappings[i - 1].base + mappings[i - 1].size))
+		return mappings + i - 1;
+	return 0;
+}
+
+static void
+commit_add(mapping_t* mapping, long long delta) {
+	if (mapping)
+		mapping->committed += (size_t)delta;
+	counter_max(&committed_peak, counter_add(&committed_bytes, delta));
+}
+
+static void*
+counting_map(size_t size, size_t alignment, size_t* offset, size_t* mapped_size) {
+	char* ptr = os_map(size, alignment, !ENABLE_DECOMMIT, offset, mapped_size);
+	if (!ptr)
+		return 0;
+	lock_acquire(&mapping_lock);
+	mapping_t* mapping = 0;
+	if (mapping_count < MAPPING_COUNT) {
+		int i = mapping_upper_bound(ptr);
+		memmove(mappings + i + 1, mappings + i, (size_t)(mapping_count - i) * sizeof(mapping_t));
+		++mapping_count;
+		mapping = mappings + i;
+		mapping->base = ptr - *offset;
+		mapping->size = *mapped_size;
+		mapping->committed = 0;
+	}
+	counter_max(&mapped_peak, counter_add(&mapped_bytes, (long long)*mapped_size));
+	if (!ENABLE_DECOMMIT)
+		commit_add(mapping, (long long)*mapped_size);
+	lock_release(&mapping_lock);
+	return ptr;
+}
+
+static void
+counting_commit(void* address, size_t size) {
+	os_commit(address, size);
+	lock_acquire(&mapping_lock);
+	commit_add(mapping_find(address), (long long)size);
+	lock_release(&mapping_lock);
+}
+
+static void
+counting_decommit(void* address, size_t size) {
+	os_decommit(address, size);
+	lock_acquire(&mapping_lock);
+	commit_add(mapping_find(address), -(long long)size);
+	lock_release(&mapping_lock);
+}
+
+static void
+counting_unmap(void* address, size_t offset, size_t mapped_size) {
+	char* base = (char*)address - offset;
+	lock_acquire(&mapping_lock);
+	mapping_t* mapping = mapping_find(base);
+	if (mapping) {
+		commit_add(0, -(long long)mapping->committed);
+		int i = (int)(mapping - mappings);
+		memmove(mappings + i, mappings + i + 1, (size_t)(mapping_count - i - 1) * sizeof(mapping_t));
+		--mapping_count;
+	}
+	counter_add(&mapped_bytes, -(long long)mapped_size);
+	lock_release(&mapping_lock);
+	os_release(base, mapped_size);
+}
+
+static rpmalloc_interface_t counting_interface = {counting_map, counting_commit, counting_decommit, counting_unmap,
+                                                  0, 0};
+
+static void
+bench_initialize(rpmalloc_config_t* config) {
+	static int lock_initialized;
+	if (!lock_initialized) {
+		lock_init(&mapping_lock);
+		lock_initialized = 1;
+	}
+	config->unmap_on_finalize = 1;
+	rpmalloc_initialize_config(&counting_interface, config);
+	footprint_reset();
+}
+
+static void
+bench_finalize(void) {
+	rpmalloc_finalize();
+	if (mapped_bytes)
+		printf("  warning: %lld bytes still mapped after finalize\n", mapped_bytes);
+}
+
+static double
+megabytes(long long bytes) {
+	return (double)bytes / (1024.0 * 1024.0);
+}
+
+static uint32_t
+random_next(uint32_t* state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+////////////
+///
+/// Span geometry
+///
+//////
+
+//! Live blocks per thread in the mixed workload
+#define MIXED_SLOTS 4096
+
+typedef struct mixed_arg_t {
+	uint32_t seed;
+	size_t ops;
+} mixed_arg_t;
+
+//! Mostly small sizes with a tail into the large page types: 60% up to 128 bytes, 25% up to 2KiB,
+//  12% up to 64KiB and 3% up to 1MiB
+static size_t
+mixed_size(uint32_t* state) {
+	uint32_t r = random_next(state);
+	uint32_t pick = r % 100;
+	r = random_next(state);
+	if (pick < 60)
+		return 8 + (r % 121);
+	if (pick < 85)
+		return 128 + (r % 1921);
+	if (pick < 97)
+		return 2048 + (r % (63 * 1024));
+	return 64 * 1024 + (r % (960 * 1024));
+}
+
+THREAD_PROC(mixed_thread, argp) {
+	mixed_arg_t* arg = (mixed_arg_t*)argp;
+	void** slot = (void**)calloc(MIXED_SLOTS, sizeof(void*));
+	uint32_t state = arg->seed;
+	for (size_t op = 0; op < arg->ops; ++op) {
+		uint32_t i = random_next(&state) % MIXED_SLOTS;
+		if (slot[i]) {
+			rpfree(slot[i]);
+			slot[i] = 0;
+		} else {
+			size_t size = mixed_size(&state);
+			slot[i] = rpmalloc(size);
+			*(char*)slot[i] = (char)op;
+		}
+	}
+	for (int i = 0; i < MIXED_SLOTS; ++i)
+		rpfree(slot[i]);
+	free(slot);
+	rpmalloc_thread_finalize();
+	THREAD_RETURN;
+}
+
+static double
+run_mixed(int threads, size_t ops) {
+	thread_t thread[64];
+	mixed_arg_t arg[64];
+	double start = time_now();
+	for (int i = 0; i < threads; ++i) {
+		arg[i].seed = 0x9E3779B9u * (uint32_t)(i + 1);
+		arg[i].ops = ops;
+		thread[i] = thread_start(mixed_thread, &arg[i]);
+	}
+	for (int i = 0; i < threads; ++i)
+		thread_join(thread[i]);
+	return time_now() - start;
+}
+
+static void
+bench_geometry(int threads, size_t ops) {
+	static const struct {
+		int geometry;
+		const char* name;
+	} profile[] = {{RPMALLOC_SPAN_GEOMETRY_LARGE, "large (256MiB spans, 64KiB/4MiB/64MiB pages)"},
+	               {RPMALLOC_SPAN_GEOMETRY_COMPACT, "compact (4MiB spans, 16KiB/256KiB/2MiB pages)"}};
+	int thread_counts[3] = {1, 4, 16};
+	int runs = 3;
+	if (threads) {
+		thread_counts[0] = threads;
+		runs = 1;
+	}
+	printf("%-48s %7s %12s %14s %10s\n", "profile", "threads", "peak mapped", "peak committed", "Mops/s");
+	for (int iprofile = 0; iprofile < 2; ++iprofile) {
+		for (int irun = 0; irun < runs; ++irun) {
+			rpmalloc_config_t config;
+			memset(&config, 0, sizeof(config));
+			config.span_geometry = profile[iprofile].geometry;
+			bench_initialize(&config);
+			double elapsed = run_mixed(thread_counts[irun], ops);
+			printf("%-48s %7d %10.1fMB %12.1fMB %10.2f\n", profile[iprofile].name, thread_counts[irun],
+			       megabytes(mapped_peak), megabytes(committed_peak),
+			       (double)ops * thread_counts[irun] / elapsed / 1e6);
+			bench_finalize();
+		}
+	}
+}
+
+////////////
+///
+/// Thread create/exit
+///
+//////
+
+#ifdef _WIN32
+#define thread_yield() SwitchToThread()
+#else
+#define thread_yield() sched_yield()
+#endif
+
+//! Released by the last started thread so a wave enters rpmalloc together
+static volatile long wave_pending;
+
+static void
+wave_wait(void) {
+#ifdef _WIN32
+	InterlockedDecrement(&wave_pending);
+#else
+	__atomic_sub_fetch(&wave_pending, 1, __ATOMIC_RELAXED);
+#endif
+	while (wave_pending > 0)
+		thread_yield();
+}
+
+THREAD_PROC(empty_thread, argp) {
+	(void)sizeof(argp);
+	wave_wait();
+	THREAD_RETURN;
+}
+
+THREAD_PROC(heap_thread, argp) {
+	void* block[32];
+	uintptr_t seed = (uintptr_t)argp;
+	wave_wait();
+	for (int i = 0; i < 32; ++i)
+		block[i] = rpmalloc(16 + ((seed + (uintptr_t)i * 37) % 1008));
+	for (int i = 0; i < 32; ++i)
+		rpfree(block[i]);
+	rpmalloc_thread_finalize();
+	THREAD_RETURN;
+}
+
+#ifdef _WIN32
+static double
+run_waves(LPTHREAD_START_ROUTINE fn, int threads, int waves) {
+#else
+static double
+run_waves(void* (*fn)(void*), int threads, int waves) {
+#endif
+	thread_t thread[64];
+	double start = time_now();
+	for (int wave = 0; wave < waves; ++wave) {
+		wave_pending = threads;
+		for (int i = 0; i < threads; ++i)
+			thread[i] = thread_start(fn, (void*)(uintptr_t)(wave * threads + i));
+		for (int i = 0; i < threads; ++i)
+			thread_join(thread[i]);
+	}
+	return time_now() - start;
+}
+
+static void
+bench_threads(int threads, int waves) {
+	rpmalloc_config_t config;
+	memset(&config, 0, sizeof(config));
+	bench_initialize(&config);
+	run_waves(heap_thread, threads, waves / 10 + 1);
+	double empty = run_waves(empty_thread, threads, waves);
+	double heap = run_waves(heap_thread, threads, waves);
+	double count = (double)threads * waves;
+	printf("threads per wave %d, waves %d\n", threads, waves);
+	printf("  create/exit only           %10.0f threads/s\n", count / empty);
+	printf("  create/alloc/free/exit     %10.0f threads/s\n", count / heap);
+	printf("  heap acquire/release cost  %10.2f us/thread\n", (heap - empty) / count * 1e6);
+	bench_finalize();
+}
+
+////////////
+///
+/// Cross-thread frees
+///
+//////
+
+//! Blocks in flight between a producer and its consumer
+#define RING_SIZE 4096
+
+#ifdef _WIN32
+#define ring_load(index) (*(index))
+#define ring_store(index, value) (*(index) = (value))
+#else
+#define ring_load(index) __atomic_load_n(index, __ATOMIC_ACQUIRE)
+#define ring_store(index, value) __atomic_store_n(index, value, __ATOMIC_RELEASE)
+#endif
+
+typedef struct ring_t {
+	void* block[RING_SIZE];
+	volatile size_t head;
+	char pad[64];
+	volatile size_t tail;
+	size_t count;
+} ring_t;
+
+THREAD_PROC(producer_thread, argp) {
+	ring_t* ring = (ring_t*)argp;
+	size_t head = 0;
+	for (size_t i = 0; i < ring->count; ++i) {
+		void* block = rpmalloc(16 + ((i * 2654435761u) % 241));
+		*(size_t*)block = i;
+		while (head - ring_load(&ring->tail) >= RING_SIZE)
+			thread_yield();
+		ring->block[head % RING_SIZE] = block;
+		ring_store(&ring->head, ++head);
+	}
+	rpmalloc_thread_finalize();
+	THREAD_RETURN;
+}
+
+THREAD_PROC(consumer_thread, argp) {
+	ring_t* ring = (ring_t*)argp;
+	size_t tail = 0;
+	while (tail < ring->count) {
+		size_t head = ring_load(&ring->head);
+		if (head == tail) {
+			thread_yield();
+			continue;
+		}
+		while (tail < head) {
+			rpfree(ring->block[tail % RING_SIZE]);
+			if (!(++tail % 4096))
+				rpmalloc_thread_collect();
+		}
+		ring_store(&ring->tail, tail);
+	}
+	rpmalloc_thread_finalize();
+	THREAD_RETURN;
+}
+
+THREAD_PROC(local_thread, argp) {
+	ring_t* ring = (ring_t*)argp;
+	for (size_t i = 0; i < ring->count; i += RING_SIZE) {
+		for (size_t j = 0; j < RING_SIZE; ++j) {
+			ring->block[j] = rpmalloc(16 + (((i + j) * 2654435761u) % 241));
+			*(size_t*)ring->block[j] = i + j;
+		}
+		for (size_t j = 0; j < RING_SIZE; ++j)
+			rpfree(ring->block[j]);
+	}
+	rpmalloc_thread_finalize();
+	THREAD_RETURN;
+}
+
+static void
+bench_remote(int pairs, size_t count) {
+	thread_t thread[64];
+	ring_t* ring = (ring_t*)calloc((size_t)pairs, sizeof(ring_t));
+	rpmalloc_config_t config;
+	memset(&config, 0, sizeof(config));
+	bench_initialize(&config);
+	for (int i = 0; i < pairs; ++i)
+		ring[i].count = count;
+	double start = time_now();
+	for (int i = 0; i < pairs; ++i)
+		thread[i] = thread_start(local_thread, &ring[i]);
+	for (int i = 0; i < pairs; ++i)
+		thread_join(thread[i]);
+	double local = time_now() - start;
+	start = time_now();
+	for (int i = 0; i < pairs; ++i) {
+		thread[2 * i] = thread_start(producer_thread, &ring[i]);
+		thread[2 * i + 1] = thread_start(consumer_thread, &ring[i]);
+	}
+	for (int i = 0; i < 2 * pairs; ++i)
+		thread_join(thread[i]);
+	double remote = time_now() - start;
+	double blocks = (double)pairs * (double)count;
+	printf("pairs %d, blocks per pair %u\n", pairs, (unsigned)count);
+	printf("  same thread alloc/free     %8.2f Mblocks/s\n", blocks / local / 1e6);
+	printf("  producer/consumer free     %8.2f Mblocks/s\n", blocks / remote / 1e6);
+	printf("  peak mapped %.1fMB, peak committed %.1fMB\n", megabytes(mapped_peak), megabytes(committed_peak));
+	bench_finalize();
+	free(ring);
+}
+
+////////////
+///
+/// Tiny object footprint
+///
+//////
+
+//! Percent of allocations and size range of each bucket of the game-like distribution
+static const struct {
+	uint32_t percent;
+	uint32_t min_size;
+	uint32_t max_size;
+} footprint_bucket[] = {{8, 4, 4},    {18, 8, 8},    {10, 12, 12},  {10, 16, 16},  {14, 20, 24},
+                        {15, 28, 48}, {15, 52, 128}, {8, 132, 512}, {2, 516, 2048}};
+
+static size_t
+footprint_size(uint32_t* state) {
+	uint32_t pick = random_next(state) % 100;
+	uint32_t ibucket = 0;
+	while (pick >= footprint_bucket[ibucket].percent) {
+		pick -= footprint_bucket[ibucket].percent;
+		++ibucket;
+	}
+	uint32_t range = footprint_bucket[ibucket].max_size - footprint_bucket[ibucket].min_size;
+	uint32_t size = footprint_bucket[ibucket].min_size + (range ? (random_next(state) % (range + 1)) : 0);
+	return (size_t)(size + 3) & ~(size_t)3;
+}
+
+static void
+bench_footprint(size_t count) {
+	rpmalloc_config_t config;
+	memset(&config, 0, sizeof(config));
+	bench_initialize(&config);
+	void** block = (void**)malloc(count * sizeof(void*));
+	uint32_t state = 0x2545F491u;
+	size_t requested = 0, used = 0;
+	long long committed_base = committed_bytes;
+	for (size_t i = 0; i < count; ++i) {
+		size_t size = footprint_size(&state);
+		block[i] = rpmalloc(size);
+		memset(block[i], 0, size);
+		requested += size;
+		used += rpmalloc_usable_size(block[i]);
+	}
+	void* probe = rpmalloc(4);
+	size_t granularity = rpmalloc_usable_size(probe);
+	rpfree(probe);
+	long long committed = committed_bytes - committed_base;
+	printf("blocks %u, smallest block %u bytes\n", (unsigned)count, (unsigned)granularity);
+	printf("  requested   %10.1fMB\n", megabytes((long long)requested));
+	printf("  block bytes %10.1fMB  (+%.1f%% rounding)\n", megabytes((long long)used),
+	       100.0 * (double)(used - requested) / (double)requested);
+	printf("  committed   %10.1fMB  (+%.1f%% over requested)\n", megabytes(committed),
+	       100.0 * ((double)committed - (double)requested) / (double)requested);
+	for (size_t i = 0; i < count; ++i)
+		rpfree(block[i]);
+	free(block);
+	bench_finalize();
+}
+
+////////////
+///
+/// Fragmentation
+///
+//////
+
+//! Blocks allocated before the unload
+#define FRAG_BLOCKS 400000
+//! Allocations sharing a survival rate in the unload
+#define FRAG_CELL_BLOCKS 2000
+
+static int
+compare_address(const void* a, const void* b) {
+	uintptr_t x = *(const uintptr_t*)a, y = *(const uintptr_t*)b;
+	return (x < y) ? -1 : (x > y);
+}
+
+//! Number of distinct small pages holding the live blocks
+static size_t
+frag_pages_in_use(void** block, uintptr_t* scratch, size_t page_size) {
+	size_t count = 0;
+	for (size_t i = 0; i < FRAG_BLOCKS; ++i) {
+		if (block[i])
+			scratch[count++] = (uintptr_t)block[i] & ~(uintptr_t)(page_size - 1);
+	}
+	qsort(scratch, count, sizeof(uintptr_t), compare_address);
+	size_t pages = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (!i || (scratch[i] != scratch[i - 1]))
+			++pages;
+	}
+	return pages;
+}
+
+static void
+bench_frag(int rounds) {
+	rpmalloc_config_t config;
+	memset(&config, 0, sizeof(config));
+	bench_initialize(&config);
+	size_t page_size = (rpmalloc_config()->span_geometry == RPMALLOC_SPAN_GEOMETRY_COMPACT) ? 16 * 1024 : 64 * 1024;
+	void** block = (void**)calloc(FRAG_BLOCKS, sizeof(void*));
+	size_t* size = (size_t*)calloc(FRAG_BLOCKS, sizeof(size_t));
+	uint32_t* live_index = (uint32_t*)calloc(FRAG_BLOCKS, sizeof(uint32_t));
+	uint32_t* free_index = (uint32_t*)calloc(FRAG_BLOCKS, sizeof(uint32_t));
+	uintptr_t* scratch = (uintptr_t*)calloc(FRAG_BLOCKS, sizeof(uintptr_t));
+	uint32_t state = 7;
+	size_t live = 0;
+	long long committed_base = committed_bytes;
+	for (uint32_t i = 0; i < FRAG_BLOCKS; ++i) {
+		size[i] = 16 + (random_next(&state) % 6) * 16;
+		block[i] = rpmalloc(size[i]);
+		memset(block[i], 1, size[i]);
+		live += size[i];
+	}
+	uint32_t keep = 0;
+	for (uint32_t i = 0; i < FRAG_BLOCKS; ++i) {
+		if (!(i % FRAG_CELL_BLOCKS))
+			keep = random_next(&state) % 50;
+		if ((random_next(&state) % 100) >= keep) {
+			rpfree(block[i]);
+			live -= size[i];
+			block[i] = 0;
+		}
+	}
+	uint32_t live_count = 0, free_count = 0;
+	for (uint32_t i = 0; i < FRAG_BLOCKS; ++i) {
+		if (block[i])
+			live_index[live_count++] = i;
+		else
+			free_index[free_count++] = i;
+	}
+	printf("%6s %10s %14s %12s\n", "round", "live", "pages in use", "committed");
+	for (int round = 0; round <= rounds; ++round) {
+		if (!(round % 20) || (round == rounds)) {
+			size_t pages = frag_pages_in_use(block, scratch, page_size);
+			printf("%6d %8.0fKB %8u (%5.0fKB) %10.0fKB\n", round, (double)live / 1024.0, (unsigned)pages,
+			       (double)(pages * page_size) / 1024.0, (double)(committed_bytes - committed_base) / 1024.0);
+		}
+		if (round == rounds)
+			break;
+		for (uint32_t k = 0; k < FRAG_BLOCKS / 40; ++k) {
+			uint32_t j = random_next(&state) % live_count;
+			uint32_t i = live_index[j];
+			rpfree(block[i]);
+			live -= size[i];
+			block[i] = 0;
+			uint32_t f = random_next(&state) % free_count;
+			uint32_t n = free_index[f];
+			free_index[f] = i;
+			size[n] = 16 + (random_next(&state) % 6) * 16;
+			block[n] = rpmalloc(size[n]);
+			memset(block[n], 1, size[n]);
+			live += size[n];
+			live_index[j] = n;
+		}
+		rpmalloc_thread_collect();
+	}
+	for (uint32_t i = 0; i < FRAG_BLOCKS; ++i)
+		rpfree(block[i]);
+	free(scratch);
+	free(free_index);
+	free(live_index);
+	free(size);
+	free(block);
+	bench_finalize();
+}
+
+//! Parse an optional thread count argument, 0 when absent, -1 when outside 1 to the limit
+static int
+parse_threads(int argc, char** argv, int limit) {
+	if (argc <= 2)
+		return 0;
+	int threads = atoi(argv[2]);
+	return ((threads < 1) || (threads > limit)) ? -1 : threads;
+}
+
+int
+main(int argc, char** argv) {
+	const char* bench = (argc > 1) ? argv[1] : "";
+	if (!strcmp(bench, "geometry") || !strcmp(bench, "threads")) {
+		int threads = parse_threads(argc, argv, 64);
+		if (threads < 0) {
+			fprintf(stderr, "threads must be 1 to 64\n");
+			return 1;
+		}
+		if (!strcmp(bench, "geometry")) {
+			size_t ops = (argc > 3) ? (size_t)strtoul(argv[3], 0, 10) : 4 * 1024 * 1024;
+			bench_geometry(threads, ops);
+		} else {
+			int waves = (argc > 3) ? atoi(argv[3]) : 2000;
+			bench_threads(threads ? threads : 16, (waves > 0) ? waves : 2000);
+		}
+		return 0;
+	}
+	if (!strcmp(bench, "remote")) {
+		int pairs = parse_threads(argc, argv, 32);
+		if (pairs < 0) {
+			fprintf(stderr, "pairs must be 1 to 32\n");
+			return 1;
+		}
+		size_t count = (argc > 3) ? (size_t)strtoul(argv[3], 0, 10) : 4 * 1024 * 1024;
+		bench_remote(pairs ? pairs : 4, count ? count : 4 * 1024 * 1024);
+		return 0;
+	}
+	if (!strcmp(bench, "footprint")) {
+		size_t count = (argc > 2) ? (size_t)strtoul(argv[2], 0, 10) : 4 * 1024 * 1024;
+		bench_footprint(count ? count : 4 * 1024 * 1024);
+		return 0;
+	}
+	if (!strcmp(bench, "frag")) {
+		int rounds = (argc > 2) ? atoi(argv[2]) : 200;
+		bench_frag((rounds > 0) ? rounds : 200);
+		return 0;
+	}
+	fprintf(stderr, "usage: rpbench geometry [threads] [ops]\n"
+	                "       rpbench threads [threads] [waves]\n"
+	                "       rpbench remote [pairs] [blocks]\n"
+	                "       rpbench footprint [blocks]\n"
+	                "       rpbench frag [rounds]\n");
+	return 1;
+}
@@ -0,0 +1,299 @@
+/* sizeclassgen.c  -  Size class table generator for rpmalloc
+ *
+ * Reads an allocation size histogram and writes rpmalloc_size_classes.h, a size class table chosen to
+ * minimize the internal fragmentation (bytes lost to rounding requests up to their class) of that
+ * histogram. rpmalloc.c picks the header up when it is found next to it (or named by
+ * RPMALLOC_SIZE_CLASS_HEADER) and switches get_size_class() to lookups in the generated table.
+ *
+ * Build:  cl /O2 tools\sizeclassgen.c     or     gcc -O2 -o sizeclassgen tools/sizeclassgen.c
+ * Usage:  sizeclassgen [-g 8|16] [-n classes] [-o rpmalloc_size_classes.h] histogram.txt
+ *
+ *   -g  Class granularity, must be a multiple of the alignment rpmalloc guarantees for the build
+ *       (16, or 8 when built with ENABLE_TINY_GRANULARITY). Default 16.
+ *   -n  Number of size classes, default 117 (133 with -g 8) like the built in table. Every class
+ *       costs two pointers in each heap, so keep it in the same range.
+ *
+ * The histogram is text with one "size count" (or "size,count") pair per line, lines starting with
+ * '#' are ignored and repeated sizes are summed. Sizes above the large block limit (8MiB) are huge
+ * blocks which are not served by size classes, they are ignored.
+ *
+ * The tool keeps the table safe for sizes the histogram did not see: the built in geometric classes
+ * are always candidates, consecutive classes are never more than 25% (or 64 bytes) apart, and the
+ * block size limits of every page type in both span geometries are always classes so page types keep
+ * serving the same ranges.
+ *
+ * This is free and unencumbered software released into the public domain.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! Largest block served by size classes, the large page limit of the large span geometry
+#define CLASS_SIZE_MAX (8 * 1024 * 1024)
+//! Sizes up to this are looked up in a direct map indexed by 8 byte units
+#define TINY_MAP_LIMIT 1024
+//! Largest number of classes, class indices are stored in bytes in the direct map
+#define CLASS_COUNT_MAX 255
+
+typedef struct bucket_t {
+	uint64_t size;
+	uint64_t count;
+} bucket_t;
+
+static int
+bucket_compare(const void* a, const void* b) {
+	uint64_t sa = ((const bucket_t*)a)->size, sb = ((const bucket_t*)b)->size;
+	return (sa < sb) ? -1 : ((sa > sb) ? 1 : 0);
+}
+
+static int
+u64_compare(const void* a, const void* b) {
+	uint64_t sa = *(const uint64_t*)a, sb = *(const uint64_t*)b;
+	return (sa < sb) ? -1 : ((sa > sb) ? 1 : 0);
+}
+
+//! Largest block size of each page type in the large and compact span geometries
+static const uint64_t page_type_limit[] = {1024, 4 * 1024, 16 * 1024, 256 * 1024, CLASS_SIZE_MAX};
+
+static int
+is_page_type_limit(uint64_t size) {
+	for (size_t i = 0; i < sizeof(page_type_limit) / sizeof(page_type_limit[0]); ++i) {
+		if (page_type_limit[i] == size)
+			return 1;
+	}
+	return 0;
+}
+
+//! Built in geometric classes above 1024 bytes, 4 subclasses per power of two
+static size_t
+default_classes(uint64_t* out) {
+	size_t count = 0;
+	for (uint64_t base = 1024; base < CLASS_SIZE_MAX; base *= 2) {
+		for (uint64_t sub = 1; sub <= 4; ++sub)
+			out[count++] = base + (base / 4) * sub;
+	}
+	return count;
+}
+
+//! Largest class allowed to follow the given class, bounding the waste for sizes not in the histogram
+static uint64_t
+class_step_limit(uint64_t size) {
+	uint64_t step = size / 4;
+	return size + ((step > 64) ? step : 64);
+}
+
+//! Bytes lost to rounding every sample up to its class in the given ascending table
+static uint64_t
+table_waste(const uint64_t* classes, size_t class_count, const bucket_t* bucket, size_t bucket_count) {
+	uint64_t waste = 0;
+	size_t iclass = 0;
+	for (size_t i = 0; i < bucket_count; ++i) {
+		while ((iclass < class_count) && (classes[iclass] < bucket[i].size))
+			++iclass;
+		if (iclass < class_count)
+			waste += (classes[iclass] - bucket[i].size) * bucket[i].count;
+	}
+	return waste;
+}
+
+int
+main(int argc, char** argv) {
+	uint64_t granularity = 16;
+	size_t class_count = 0;
+	const char* output = "rpmalloc_size_classes.h";
+	const char* input = 0;
+	for (int iarg = 1; iarg < argc; ++iarg) {
+		if (!strcmp(argv[iarg], "-g") && (iarg + 1 < argc))
+			granularity = strtoull(argv[++iarg], 0, 10);
+		else if (!strcmp(argv[iarg], "-n") && (iarg + 1 < argc))
+			class_count = (size_t)strtoull(argv[++iarg], 0, 10);
+		else if (!strcmp(argv[iarg], "-o") && (iarg + 1 < argc))
+			output = argv[++iarg];
+		else if (argv[iarg][0] != '-')
+			input = argv[iarg];
+		else
+			input = 0, iarg = argc;
+	}
+	if (!input || ((granularity != 8) && (granularity != 16))) {
+		fprintf(stderr, "usage: %s [-g 8|16] [-n classes] [-o rpmalloc_size_classes.h] histogram.txt\n", argv[0]);
+		return 1;
+	}
+	if (!class_count)
+		class_count = (granularity == 8) ? 133 : 117;
+
+	FILE* in = fopen(input, "r");
+	if (!in) {
+		fprintf(stderr, "unable to open %s\n", input);
+		return 1;
+	}
+	size_t bucket_capacity = 4096, bucket_count = 0;
+	bucket_t* bucket = malloc(sizeof(bucket_t) * bucket_capacity);
+	char line[256];
+	while (fgets(line, sizeof(line), in)) {
+		unsigned long long size, count;
+		if ((line[0] == '#') || (sscanf(line, "%llu%*[ ,\t]%llu", &size, &count) != 2) || !count)
+			continue;
+		if (size > CLASS_SIZE_MAX)
+			continue;
+		if (bucket_count == bucket_capacity) {
+			bucket_capacity *= 2;
+			bucket = realloc(bucket, sizeof(bucket_t) * bucket_capacity);
+		}
+		bucket[bucket_count].size = size ? size : 1;
+		bucket[bucket_count].count = count;
+		++bucket_count;
+	}
+	fclose(in);
+	if (!bucket_count) {
+		fprintf(stderr, "no samples in %s\n", input);
+		return 1;
+	}
+	qsort(bucket, bucket_count, sizeof(bucket_t), bucket_compare);
+	size_t merged = 0;
+	for (size_t i = 0; i < bucket_count; ++i) {
+		if (merged && (bucket[merged - 1].size == bucket[i].size))
+			bucket[merged - 1].count += bucket[i].count;
+		else
+			bucket[merged++] = bucket[i];
+	}
+	bucket_count = merged;
+
+	// Candidate class sizes: every granular size up to 1024 bytes, the built in geometric classes and the
+	// histogram sizes rounded up to the granularity
+	size_t candidate_capacity = (TINY_MAP_LIMIT / granularity) + 64 + bucket_count;
+	uint64_t* candidate = malloc(sizeof(uint64_t) * candidate_capacity);
+	size_t candidate_count = 0;
+	for (uint64_t size = granularity; size <= TINY_MAP_LIMIT; size += granularity)
+		candidate[candidate_count++] = size;
+	candidate_count += default_classes(candidate + candidate_count);
+	for (size_t i = 0; i < bucket_count; ++i)
+		candidate[candidate_count++] = (bucket[i].size + granularity - 1) & ~(granularity - 1);
+	qsort(candidate, candidate_count, sizeof(uint64_t), u64_compare);
+	merged = 0;
+	for (size_t i = 0; i < candidate_count; ++i) {
+		if (!merged || (candidate[merged - 1] != candidate[i]))
+			candidate[merged++] = candidate[i];
+	}
+	candidate_count = merged;
+
+	if (class_count > CLASS_COUNT_MAX) {
+		fprintf(stderr, "class count must be at most %u\n", CLASS_COUNT_MAX);
+		return 1;
+	}
+
+	// Prefix sums of sample counts and bytes, so the waste of serving all samples in (candidate[j], candidate[i]]
+	// with class candidate[i] is candidate[i] * count - bytes
+	uint64_t* prefix_count = calloc(candidate_count + 1, sizeof(uint64_t));
+	uint64_t* prefix_bytes = calloc(candidate_count + 1, sizeof(uint64_t));
+	size_t ibucket = 0;
+	for (size_t i = 0; i < candidate_count; ++i) {
+		prefix_count[i + 1] = prefix_count[i];
+		prefix_bytes[i + 1] = prefix_bytes[i];
+		while ((ibucket < bucket_count) && (bucket[ibucket].size <= candidate[i])) {
+			prefix_count[i + 1] += bucket[ibucket].count;
+			prefix_bytes[i + 1] += bucket[ibucket].size * bucket[ibucket].count;
+			++ibucket;
+		}
+	}
+
+	// Classes may not skip past the next page type limit
+	size_t* next_mandatory = malloc(sizeof(size_t) * candidate_count);
+	size_t next = candidate_count - 1;
+	for (size_t i = candidate_count; i-- > 0;) {
+		next_mandatory[i] = next;
+		if (is_page_type_limit(candidate[i]))
+			next = i;
+	}
+
+	// Dynamic programming over (classes used, largest class), cost[k][i] is the least waste of all samples up
+	// to candidate[i] using k + 1 classes with candidate[i] as the largest. The first class is always the
+	// granularity so size 1 has a class.
+	const uint64_t infinite = ~(uint64_t)0;
+	uint64_t* cost = malloc(sizeof(uint64_t) * class_count * candidate_count);
+	uint32_t* from = malloc(sizeof(uint32_t) * class_count * candidate_count);
+	for (size_t i = 0; i < class_count * candidate_count; ++i)
+		cost[i] = infinite;
+	cost[0] = candidate[0] * prefix_count[1] - prefix_bytes[1];
+	for (size_t k = 1; k < class_count; ++k) {
+		uint64_t* prev = cost + (k - 1) * candidate_count;
+		uint64_t* cur = cost + k * candidate_count;
+		uint32_t* cur_from = from + k * candidate_count;
+		for (size_t j = 0; j < candidate_count; ++j) {
+			if (prev[j] == infinite)
+				continue;
+			uint64_t step_limit = class_step_limit(candidate[j]);
+			for (size_t i = j + 1; (i <= next_mandatory[j]) && (candidate[i] <= step_limit); ++i) {
+				uint64_t waste = candidate[i] * (prefix_count[i + 1] - prefix_count[j + 1]) -
+				                 (prefix_bytes[i + 1] - prefix_bytes[j + 1]);
+				if (prev[j] + waste < cur[i]) {
+					cur[i] = prev[j] + waste;
+					cur_from[i] = (uint32_t)j;
+				}
+			}
+		}
+	}
+	// More classes never waste more, but there may be fewer candidates than requested classes
+	size_t last = candidate_count - 1;
+	size_t used = 0;
+	for (size_t k = 0; k < class_count; ++k) {
+		if ((cost[k * candidate_count + last] != infinite) &&
+		    (!used || (cost[k * candidate_count + last] < cost[(used - 1) * candidate_count + last])))
+			used = k + 1;
+	}
+	if (!used) {
+		fprintf(stderr, "%u classes are too few to cover all sizes\n", (unsigned)class_count);
+		return 1;
+	}
+	uint64_t* classes = malloc(sizeof(uint64_t) * used);
+	size_t iclass = used;
+	for (size_t i = last, k = used; k-- > 0; i = from[k * candidate_count + i])
+		classes[--iclass] = candidate[i];
+
+	// Compare with the built in table of the same granularity
+	uint64_t builtin[(TINY_MAP_LIMIT / 8) + 64];
+	size_t builtin_count = 0;
+	for (uint64_t size = granularity; size <= TINY_MAP_LIMIT; size += granularity)
+		builtin[builtin_count++] = size;
+	builtin_count += default_classes(builtin + builtin_count);
+
+	uint64_t total_bytes = prefix_bytes[candidate_count];
+	uint64_t waste = cost[(used - 1) * candidate_count + last];
+	uint64_t builtin_waste = table_waste(builtin, builtin_count, bucket, bucket_count);
+	fprintf(stderr, "%llu samples, %u classes, internal fragmentation %.2f%% (built in table %.2f%%)\n",
+	        (unsigned long long)prefix_count[candidate_count], (unsigned)used,
+	        total_bytes ? (100.0 * (double)waste / (double)total_bytes) : 0.0,
+	        total_bytes ? (100.0 * (double)builtin_waste / (double)total_bytes) : 0.0);
+
+	FILE* out = fopen(output, "w");
+	if (!out) {
+		fprintf(stderr, "unable to create %s\n", output);
+		return 1;
+	}
+	fprintf(out, "/* rpmalloc_size_classes.h  -  Generated by tools/sizeclassgen from %s, do not edit\n", input);
+	fprintf(out, " *\n * %llu samples, internal fragmentation %.2f%%\n */\n\n",
+	        (unsigned long long)prefix_count[candidate_count],
+	        total_bytes ? (100.0 * (double)waste / (double)total_bytes) : 0.0);
+	fprintf(out, "#pragma once\n\n");
+	fprintf(out, "#define RPMALLOC_GENERATED_SIZE_CLASS_COUNT %u\n", (unsigned)used);
+	fprintf(out, "#define RPMALLOC_GENERATED_SIZE_CLASS_GRANULARITY %u\n\n", (unsigned)granularity);
+	fprintf(out, "//! Block size of each class in bytes, ascending, GCLASS is defined by rpmalloc.c\n");
+	fprintf(out, "#define RPMALLOC_GENERATED_SIZE_CLASSES \\\n");
+	for (size_t i = 0; i < used; ++i)
+		fprintf(out, "%sGCLASS(%llu)%s", (i % 8) ? " " : "    ", (unsigned long long)classes[i],
+		        (i + 1 == used) ? "\n\n" : (((i % 8) == 7) ? ", \\\n" : ","));
+	fprintf(out, "//! Size class for each size up to %u bytes in 8 byte units, indexed by (size + 7) / 8\n",
+	        TINY_MAP_LIMIT);
+	fprintf(out, "#define RPMALLOC_GENERATED_SIZE_CLASS_MAP \\\n");
+	iclass = 0;
+	for (uint64_t unit = 0; unit <= TINY_MAP_LIMIT / 8; ++unit) {
+		while (classes[iclass] < unit * 8)
+			++iclass;
+		fprintf(out, "%s%u%s", (unit % 16) ? " " : "    ", (unsigned)iclass,
+		        (unit == TINY_MAP_LIMIT / 8) ? "\n" : (((unit % 16) == 15) ? ", \\\n" : ","));
+	}
+
+	fclose(out);
+	return 0;
+}
@@ -140,8 +140,8 @@ static void ProcessDelayedFrees(bool force) {
     LeaveCriticalSection(&g_queue_lock);
 }
 
-// Hooked VirtualFree function
-static bool LowVAAvailable() {
+// True when the largest free region near the top of VA is below the low-VA trigger
+bool LowVAAvailable() {
     // Probe top-of-VA largest free region
     SYSTEM_INFO si{}; GetSystemInfo(&si);
     uintptr_t maxA = (uintptr_t)si.lpMaximumApplicationAddress;
@@ -161,6 +161,7 @@ static bool LowVAAvailable() {
     return largest < thresh;
 }
 
+// Hooked VirtualFree function
 static BOOL WINAPI Hooked_VirtualFree(LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType) {
     if (!g_hook_active || !g_original_VirtualFree) {
         return g_original_VirtualFree ? g_original_VirtualFree(lpAddress, dwSize, dwFreeType) : FALSE;
@@ -38,3 +38,6 @@ void GetVirtualFreeStats(VirtualFreeStats* stats);
 
 // Flush delayed operations (call before exit)
 void FlushDelayedFrees();
+
+// True when the largest free region near the top of VA is below the low-VA trigger
+bool LowVAAvailable();